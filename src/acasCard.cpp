@@ -62,36 +62,63 @@ bool AcasCard::getA0AuthKcl(sha256_t& output) {
 
 bool AcasCard::ecm(const std::vector<uint8_t>& ecm, DecryptionKey& output) {
     ApduResponse response;
-    sha256_t kcl;
     uint32_t retryCount = 0;
     if (smartCard == nullptr) {
         return false;
     }
 
     try {
+        // Cards that run the exchange themselves answer with the key directly.
+        uint32_t ret = smartCard->resolveEcm(ecm, response);
+        if (ret != SCARD_E_UNSUPPORTED_FEATURE) {
+            if (ret != SCARD_S_SUCCESS || !response.isSuccess() || response.getData().size() < 0x20) {
+                return false;
+            }
+
+            auto key = response.getData();
+            std::copy(key.begin(), key.begin() + 0x10, output.odd.begin());
+            std::copy(key.begin() + 0x10, key.begin() + 0x20, output.even.begin());
+            return true;
+        }
+
     retry:
         if (!smartCard->isInited()) {
             smartCard->init();
         }
         if (!smartCard->isConnected()) {
+            // A new session needs a new session key.
+            kcl.reset();
             smartCard->connect();
         }
 
         auto scope = smartCard->scopedTransaction();
 
-        if (!getA0AuthKcl(kcl)) {
-            if (retryCount > 1) {
-                return false;
-            }
+        // Another client of a shared card may have run A0 since the last
+        // transaction, so the session key is only kept on exclusive cards.
+        if (!smartCard->isExclusive()) {
+            kcl.reset();
+        }
 
-            ++retryCount;
-            goto retry;
+        bool authenticated = false;
+        if (!kcl) {
+            sha256_t newKcl;
+            if (!getA0AuthKcl(newKcl)) {
+                if (retryCount > 1) {
+                    return false;
+                }
+
+                ++retryCount;
+                goto retry;
+            }
+            kcl = newKcl;
+            authenticated = true;
         }
 
         ApduCommand apdu(0x90, 0x34, 0x00, 0x01);
-        uint32_t ret = smartCard->transmit(apdu.case4short(ecm, 0x00), response);
+        ret = smartCard->transmit(apdu.case4short(ecm, 0x00), response);
         if (ret != SCARD_S_SUCCESS) {
             if (ret == SCARD_W_RESET_CARD || ret == SCARD_E_INVALID_HANDLE) {
+                kcl.reset();
                 if (retryCount > 1) {
                     return false;
                 }
@@ -103,8 +130,16 @@ bool AcasCard::ecm(const std::vector<uint8_t>& ecm, DecryptionKey& output) {
             return false;
         }
 
-        if (!response.isSuccess()) {
-            return false;
+        if (!response.isSuccess() || response.getData().size() < 0x06 + 0x20) {
+            // The card may have been authenticated by someone else in the
+            // meantime. Authenticate again once before giving up on the ECM.
+            kcl.reset();
+            if (authenticated || retryCount > 1) {
+                return false;
+            }
+
+            ++retryCount;
+            goto retry;
         }
 
         auto ecmData = response.getData();
@@ -112,7 +147,7 @@ bool AcasCard::ecm(const std::vector<uint8_t>& ecm, DecryptionKey& output) {
         std::vector<uint8_t> ecmInit(ecm.begin() + 0x04, ecm.begin() + 0x04 + 0x17);
 
         std::vector<uint8_t> plainData;
-        plainData.insert(plainData.end(), kcl.begin(), kcl.end());
+        plainData.insert(plainData.end(), kcl->begin(), kcl->end());
         plainData.insert(plainData.end(), ecmInit.begin(), ecmInit.end());
 
         sha256_t hash = SHA256::hash(plainData);
@@ -127,12 +162,57 @@ bool AcasCard::ecm(const std::vector<uint8_t>& ecm, DecryptionKey& output) {
         return true;
     }
     catch (const std::runtime_error& e) {
+        kcl.reset();
         std::cerr << e.what() << std::endl;
     }
 
     return false;
 }
 
+bool AcasCard::warmUp() {
+    if (smartCard == nullptr) {
+        return false;
+    }
+
+    try {
+        uint32_t ret = smartCard->prepareResolveEcm();
+        if (ret != SCARD_E_UNSUPPORTED_FEATURE) {
+            return ret == SCARD_S_SUCCESS;
+        }
+
+        if (!smartCard->isInited()) {
+            smartCard->init();
+        }
+        if (!smartCard->isConnected()) {
+            kcl.reset();
+            smartCard->connect();
+        }
+        // A session key of a shared card would not survive until the first
+        // ECM, which authenticates in its own transaction anyway.
+        if (kcl || !smartCard->isExclusive()) {
+            return true;
+        }
+
+        auto scope = smartCard->scopedTransaction();
+        sha256_t newKcl;
+        if (!getA0AuthKcl(newKcl)) {
+            return false;
+        }
+        kcl = newKcl;
+        return true;
+    }
+    catch (const std::runtime_error&) {
+        // The first ECM tries again and reports the error.
+        kcl.reset();
+    }
+
+    return false;
+}
+
 void AcasCard::setSmartCard(std::unique_ptr<ISmartCard> sc) {
     smartCard = std::move(sc);
 }
+
+void AcasCard::resetSession() {
+    kcl.reset();
+}
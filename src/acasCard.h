@@ -22,11 +22,22 @@ public:
     };
 
     bool ecm(const std::vector<uint8_t>& ecm, DecryptionKey& output);
+    // Does the work of the first ECM ahead of time: connects the card, or the
+    // proxy that resolves ECMs, and runs A0 authentication on exclusive cards.
+    bool warmUp();
     void setSmartCard(std::unique_ptr<ISmartCard> sc);
+    // Forgets the session key, e.g. after APDUs of someone else reached the card.
+    void resetSession();
 
 private:
     bool getA0AuthKcl(sha256_t& output);
 
     std::unique_ptr<ISmartCard> smartCard;
 
+    // Session key of the current card session. The card keeps it until it is
+    // reset, so A0 authentication runs once per session instead of before
+    // every ECM, as long as the card is not shared with anyone else. Cleared
+    // on a reset, a reconnect or a rejected ECM.
+    std::optional<sha256_t> kcl;
+
 };
@@ -0,0 +1,229 @@
+#include "acasEcmWorker.h"
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+AcasEcmWorker::AcasEcmWorker()
+    : ecmKeyCache(std::make_shared<EcmKeyCache>()) {
+}
+
+AcasEcmWorker::~AcasEcmWorker() {
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        running = false;
+    }
+
+    queueCv.notify_all();
+    for (auto& card : cards) {
+        if (card->thread.joinable()) {
+            card->thread.join();
+        }
+    }
+}
+
+void AcasEcmWorker::addSmartCard(std::unique_ptr<ISmartCard> sc) {
+    auto card = std::make_unique<Card>();
+    card->readerName = sc->getSmartCardReaderName();
+    card->acasCard = std::make_unique<AcasCard>();
+    card->acasCard->setSmartCard(std::move(sc));
+    card->thread = std::thread(&AcasEcmWorker::worker, this, std::ref(*card));
+    cards.push_back(std::move(card));
+}
+
+void AcasEcmWorker::setEcmKeyCache(std::shared_ptr<EcmKeyCache> cache) {
+    ecmKeyCache = std::move(cache);
+}
+
+void AcasEcmWorker::setPrintWarmUp(bool enabled) {
+    printWarmUp = enabled;
+}
+
+void AcasEcmWorker::submit(Request request) {
+    sha256_t ecmHash = EcmKeyCache::hashEcm(request.ecm);
+
+    if (cards.empty()) {
+        // Nothing to send the ECM to, answer from the cache or reject it.
+        auto cached = ecmKeyCache ? ecmKeyCache->peek(ecmHash) : std::nullopt;
+        request.onComplete(cached ? *cached : AcasCard::DecryptionKey{});
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        auto it = pendingEcms.find(ecmHash);
+        if (it != pendingEcms.end()) {
+            it->second->requests.push_back(std::move(request));
+            ++mergedCount;
+            return;
+        }
+
+        auto pending = std::make_shared<PendingEcm>();
+        pending->ecm = std::move(request.ecm);
+        pending->ecmHash = ecmHash;
+        pending->requests.push_back(std::move(request));
+        pendingEcms.emplace(ecmHash, pending);
+        queue.push_back(std::move(pending));
+        maxQueueDepth = std::max(maxQueueDepth, queue.size());
+    }
+    queueCv.notify_one();
+}
+
+void AcasEcmWorker::worker(Card& card) {
+    warmUp(card);
+
+    while (true) {
+        std::shared_ptr<PendingEcm> current;
+        std::vector<Request> staleRequests;
+        {
+            std::unique_lock<std::mutex> lock(queueMutex);
+            queueCv.wait(lock, [&]() {
+                return !queue.empty() || !running;
+            });
+
+            if (!running) {
+                break;
+            }
+
+            current = std::move(queue.front());
+            queue.pop_front();
+
+            auto stale = std::stable_partition(current->requests.begin(), current->requests.end(), [](const Request& request) {
+                return !request.isStale || !request.isStale();
+            });
+            staleRequests.assign(std::make_move_iterator(stale), std::make_move_iterator(current->requests.end()));
+            current->requests.erase(stale, current->requests.end());
+
+            if (current->requests.empty()) {
+                pendingEcms.erase(current->ecmHash);
+                current.reset();
+            }
+        }
+
+        for (auto& request : staleRequests) {
+            request.onComplete(std::nullopt);
+        }
+        if (!current) {
+            continue;
+        }
+
+        auto key = resolve(card, *current);
+
+        // Requests merged while the card was busy get the same answer.
+        std::vector<Request> requests;
+        {
+            std::lock_guard<std::mutex> lock(queueMutex);
+            pendingEcms.erase(current->ecmHash);
+            requests = std::move(current->requests);
+        }
+        for (auto& request : requests) {
+            request.onComplete(key);
+        }
+    }
+}
+
+void AcasEcmWorker::warmUp(Card& card) {
+    auto start = std::chrono::steady_clock::now();
+    bool ok = card.acasCard->warmUp();
+    auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+    card.warmUpTime = elapsed.count();
+    card.warmedUp = ok;
+
+    if (!printWarmUp) {
+        return;
+    }
+
+    std::ostringstream oss;
+    oss << "Smart card";
+    if (!card.readerName.empty()) {
+        oss << " (" << card.readerName << ")";
+    }
+    oss << (ok ? " ready in " : " warm-up failed after ")
+        << std::fixed << std::setprecision(1) << std::chrono::duration<double, std::milli>(elapsed).count() << " ms";
+    std::cerr << oss.str() << std::endl;
+}
+
+std::optional<AcasCard::DecryptionKey> AcasEcmWorker::resolve(Card& card, const PendingEcm& pending) {
+    if (ecmKeyCache) {
+        auto cached = ecmKeyCache->peek(pending.ecmHash);
+        if (cached) {
+            return cached;
+        }
+    }
+
+    card.busy = true;
+    auto start = std::chrono::steady_clock::now();
+    AcasCard::DecryptionKey key = {};
+    bool ok = card.acasCard->ecm(pending.ecm, key);
+    uint64_t latency = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+    card.busy = false;
+
+    ++card.ecmCount;
+    card.totalLatency += latency;
+    if (latency > card.maxLatency) {
+        // Only this card's thread writes its statistics.
+        card.maxLatency = latency;
+    }
+
+    if (!ok) {
+        ++card.failedCount;
+    }
+    else if (ecmKeyCache) {
+        ecmKeyCache->insert(pending.ecmHash, key);
+    }
+    return key;
+}
+
+std::vector<AcasEcmWorker::CardStatistics> AcasEcmWorker::getCardStatistics() const {
+    std::vector<CardStatistics> result;
+    for (const auto& card : cards) {
+        CardStatistics statistics;
+        statistics.readerName = card->readerName;
+        statistics.ecmCount = card->ecmCount;
+        statistics.failedCount = card->failedCount;
+        if (statistics.ecmCount > 0) {
+            statistics.averageLatency = std::chrono::microseconds(card->totalLatency / statistics.ecmCount);
+        }
+        statistics.maxLatency = std::chrono::microseconds(card->maxLatency);
+        statistics.queueDepth = card->busy ? 1 : 0;
+        statistics.warmedUp = card->warmedUp;
+        statistics.warmUpTime = std::chrono::microseconds(card->warmUpTime);
+        result.push_back(std::move(statistics));
+    }
+    return result;
+}
+
+size_t AcasEcmWorker::getQueueDepth() const {
+    std::lock_guard<std::mutex> lock(queueMutex);
+    return queue.size();
+}
+
+void AcasEcmWorker::printStatistics() const {
+    auto toMilliseconds = [](std::chrono::microseconds d) {
+        return std::chrono::duration<double, std::milli>(d).count();
+    };
+
+    std::cerr << "Smart cards:" << std::endl;
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        std::cerr << " - Max queue depth: " << maxQueueDepth << std::endl;
+        std::cerr << " - Merged ECMs: " << mergedCount << std::endl;
+    }
+
+    auto statistics = getCardStatistics();
+    for (size_t i = 0; i < statistics.size(); ++i) {
+        const auto& card = statistics[i];
+        std::cerr << " - Card " << i;
+        if (!card.readerName.empty()) {
+            std::cerr << " (" << card.readerName << ")";
+        }
+        std::cerr << ": " << card.ecmCount << " ECMs, " << card.failedCount << " failed, "
+            << std::fixed << std::setprecision(1) << toMilliseconds(card.averageLatency) << " ms average, "
+            << toMilliseconds(card.maxLatency) << " ms max, "
+            << (card.warmedUp ? "warm-up " : "warm-up failed after ") << toMilliseconds(card.warmUpTime) << " ms" << std::endl;
+    }
+
+    if (ecmKeyCache) {
+        ecmKeyCache->printStatistics();
+    }
+}
@@ -0,0 +1,118 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+#include "acasCard.h"
+#include "ecmKeyCache.h"
+
+// Sends ECMs to a pool of smart card sessions, one thread per card.
+// A single worker is meant to be shared by every AcasHandler of the process,
+// e.g. the demuxers of several services or of a batch of recordings of one
+// channel, so that the cards are initialized once and each distinct ECM
+// reaches a card once:
+//  - ECMs wait in one queue and are taken by whichever card is idle,
+//  - identical ECMs that are queued or in flight are merged, every request
+//    gets the same answer,
+//  - ECMs already resolved are answered from the ECM key cache, which keeps
+//    the keys the cards returned. AcasHandler looks it up itself before
+//    submitting, so a key another handler or EcmPrefetcher already resolved
+//    is used without waiting for the worker.
+class AcasEcmWorker {
+public:
+    struct Request {
+        std::vector<uint8_t> ecm;
+        // Checked right before the ECM is sent. Stale requests are not sent
+        // and complete with std::nullopt.
+        std::function<bool()> isStale;
+        // Called on a worker thread. The key is zero if the card rejected the ECM.
+        std::function<void(std::optional<AcasCard::DecryptionKey>)> onComplete;
+    };
+
+    struct CardStatistics {
+        std::string readerName;
+        uint64_t ecmCount{0};
+        uint64_t failedCount{0};
+        std::chrono::microseconds averageLatency{0};
+        std::chrono::microseconds maxLatency{0};
+        // Number of ECMs the card is working on, 0 or 1.
+        size_t queueDepth{0};
+        bool warmedUp{false};
+        std::chrono::microseconds warmUpTime{0};
+    };
+
+    // Starts with an in-memory ECM key cache.
+    AcasEcmWorker();
+    ~AcasEcmWorker();
+
+    AcasEcmWorker(const AcasEcmWorker&) = delete;
+    AcasEcmWorker& operator=(const AcasEcmWorker&) = delete;
+
+    // Adds a card to the pool. Add every card before submitting requests.
+    // The card warms up on its own thread right away, connecting and, if it
+    // is exclusive, authenticating while the input is being opened, and
+    // reports how long that took. ECMs submitted meanwhile wait in the queue.
+    void addSmartCard(std::unique_ptr<ISmartCard> sc);
+    // Replaces the in-memory cache, e.g. with a persistent one. Set before
+    // any request is submitted.
+    void setEcmKeyCache(std::shared_ptr<EcmKeyCache> cache);
+    // Whether the cards report how long their warm-up took. Set before adding
+    // cards.
+    void setPrintWarmUp(bool enabled);
+    EcmKeyCache* getEcmKeyCache() const { return ecmKeyCache.get(); }
+    void submit(Request request);
+
+    std::vector<CardStatistics> getCardStatistics() const;
+    // Number of ECMs waiting for an idle card.
+    size_t getQueueDepth() const;
+    // Prints the statistics of the cards and of the ECM key cache.
+    void printStatistics() const;
+
+private:
+    struct Card {
+        std::unique_ptr<AcasCard> acasCard;
+        std::string readerName;
+        std::thread thread;
+
+        std::atomic<bool> busy{false};
+        std::atomic<uint64_t> ecmCount{0};
+        std::atomic<uint64_t> failedCount{0};
+        std::atomic<uint64_t> totalLatency{0};
+        std::atomic<uint64_t> maxLatency{0};
+        std::atomic<bool> warmedUp{false};
+        std::atomic<uint64_t> warmUpTime{0};
+    };
+
+    // An ECM that is queued or in flight with every request waiting for it.
+    struct PendingEcm {
+        std::vector<uint8_t> ecm;
+        sha256_t ecmHash;
+        std::vector<Request> requests;
+    };
+
+    void worker(Card& card);
+    void warmUp(Card& card);
+    std::optional<AcasCard::DecryptionKey> resolve(Card& card, const PendingEcm& pending);
+
+    std::vector<std::unique_ptr<Card>> cards;
+    std::shared_ptr<EcmKeyCache> ecmKeyCache;
+
+    std::deque<std::shared_ptr<PendingEcm>> queue;
+    std::map<sha256_t, std::shared_ptr<PendingEcm>> pendingEcms;
+    mutable std::mutex queueMutex;
+    std::condition_variable queueCv;
+    bool running{true};
+
+    size_t maxQueueDepth{0};
+    uint64_t mergedCount{0};
+    bool printWarmUp{true};
+
+};
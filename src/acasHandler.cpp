@@ -1,24 +1,70 @@
 #include "acasHandler.h"
 #include "config.h"
 #include "mmtp.h"
-#include "aes.h"
+#include "mmtFragment.h"
+#include "threadPool.h"
+#include <latch>
 
-AcasHandler::AcasHandler() {
-    acasCard = std::make_unique<AcasCard>();
-    workerThread = std::thread(&AcasHandler::worker, this);
-    hasAESNI = AESCtrCipher::hasAESNI();
+namespace {
+
+// Batches smaller than this are not worth handing to other threads.
+constexpr size_t kMinParallelPackets = 32;
+
+std::array<uint8_t, 16> makeIv(const MmtTlv::Mmtp& mmtp) {
+    std::array<uint8_t, 16> iv{};
+    uint16_t packetIdBe = MmtTlv::Common::swapEndian16(mmtp.packetId);
+    uint32_t packetSequenceNumberBe = MmtTlv::Common::swapEndian32(mmtp.packetSequenceNumber);
+    memcpy(iv.data(), &packetIdBe, 2);
+    memcpy(iv.data() + 2, &packetSequenceNumberBe, 4);
+    return iv;
 }
 
-AcasHandler::~AcasHandler() {
-    {
-        std::lock_guard<std::mutex> lock(queueMutex);
-        running = false;
+// A wrong key turns the payload into noise, so a decrypted MFU whose length
+// field adds up shows that the key is right. An MFU holding one whole HEVC
+// NAL unit starts with its length, and every access unit starts with such an
+// MFU, its access unit delimiter. Other payloads tell nothing either way.
+bool isRecognizableMfu(const MmtTlv::Mmtp& mmtp, std::span<const uint8_t> payload) {
+    // MPU payload header, then the data unit header of a timed MFU
+    constexpr size_t kMpuHeaderSize = 8;
+    constexpr size_t kDataUnitHeaderSize = 14;
+
+    if (mmtp.payloadType != MmtTlv::PayloadType::Mpu || payload.size() < kMpuHeaderSize + kDataUnitHeaderSize + 4) {
+        return false;
     }
 
-    queueCv.notify_one();
-    if (workerThread.joinable()) {
-        workerThread.join();
+    uint8_t flags = payload[2];
+    auto fragmentType = static_cast<MmtTlv::FragmentType>(flags >> 4);
+    bool timedFlag = (flags >> 3) & 1;
+    auto fragmentationIndicator = static_cast<MmtTlv::FragmentationIndicator>((flags >> 1) & 0b11);
+    bool aggregateFlag = flags & 1;
+    if (fragmentType != MmtTlv::FragmentType::Mfu || !timedFlag || aggregateFlag ||
+        fragmentationIndicator != MmtTlv::FragmentationIndicator::NotFragmented) {
+        return false;
     }
+
+    const uint8_t* nal = payload.data() + kMpuHeaderSize + kDataUnitHeaderSize;
+    uint32_t nalSize = (nal[0] << 24) | (nal[1] << 16) | (nal[2] << 8) | nal[3];
+    return nalSize == payload.size() - kMpuHeaderSize - kDataUnitHeaderSize - 4;
+}
+
+}
+
+AcasHandler::AcasHandler()
+    : AcasHandler(std::make_shared<AcasEcmWorker>()) {
+}
+
+AcasHandler::AcasHandler(std::shared_ptr<AcasEcmWorker> ecmWorker)
+    : ecmWorker(std::move(ecmWorker)) {
+    hasAESNI = AESCtrCipher::hasAESNI();
+}
+
+AcasHandler::~AcasHandler() {
+    // The worker may outlive this handler, wait for callbacks that refer to it.
+    generation.fetch_add(1, std::memory_order_relaxed);
+    std::unique_lock<std::mutex> lock(queueMutex);
+    queueCv.wait(lock, [&]() {
+        return pendingEcms == 0;
+    });
 }
 
 bool AcasHandler::onEcm(const std::vector<uint8_t>& ecm) {
@@ -27,126 +73,259 @@ bool AcasHandler::onEcm(const std::vector<uint8_t>& ecm) {
     }
     lastEcm = ecm;
 
+    uint64_t ecmGeneration = generation.load(std::memory_order_relaxed);
+    uint64_t sequence = ecmSequence.fetch_add(1, std::memory_order_relaxed) + 1;
+
+    sha256_t ecmHash = EcmKeyCache::hashEcm(ecm);
+
+    // ECMs found in the worker's cache are resolved right away, without waking it.
+    if (EcmKeyCache* ecmKeyCache = ecmWorker->getEcmKeyCache()) {
+        auto key = ecmKeyCache->find(ecmHash);
+        if (key) {
+            publishKey(ecmGeneration, sequence, ecmHash, *key);
+            ecmReady = true;
+            return true;
+        }
+    }
+
     {
         std::lock_guard<std::mutex> lock(queueMutex);
-        queue.push({ generation.load(std::memory_order_relaxed), ecm });
-        processing = true;
+        ++pendingEcms;
     }
-    queueCv.notify_one();
+
+    AcasEcmWorker::Request request;
+    request.ecm = ecm;
+    request.isStale = [this, ecmGeneration]() {
+        return generation.load(std::memory_order_relaxed) != ecmGeneration;
+    };
+    request.onComplete = [this, ecmGeneration, sequence, ecmHash](std::optional<AcasCard::DecryptionKey> key) {
+        onEcmResponse(ecmGeneration, sequence, ecmHash, key);
+    };
+    ecmWorker->submit(std::move(request));
     ecmReady = true;
 
     return true;
 }
 
 bool AcasHandler::decrypt(MmtTlv::Mmtp& mmtp) {
-    auto key = getDecryptionKey(mmtp.extensionHeaderScrambling->encryptionFlag);
-    if (!key) {
+    auto keyType = mmtp.extensionHeaderScrambling->encryptionFlag;
+    const KeyContext* context = getKeyContext(keyType);
+    if (!context) {
         return false;
     }
 
-    std::array<uint8_t, 16> iv{};
-    uint16_t packetIdBe = MmtTlv::Common::swapEndian16(mmtp.packetId);
-    uint32_t packetSequenceNumberBe = MmtTlv::Common::swapEndian32(mmtp.packetSequenceNumber);
-    memcpy(iv.data(), &packetIdBe, 2);
-    memcpy(iv.data() + 2, &packetSequenceNumberBe, 4);
+    auto payload = mmtp.getWritablePayload();
+    if (payload.empty()) {
+        return false;
+    }
+
+    std::array<uint8_t, 16> iv = makeIv(mmtp);
 
     if (hasAESNI) { [[likely]]
-        if (lastKey != *key) { [[unlikely]]
-            aes.setKey(*key);
-            lastKey = *key;
-        }
-        aes.setIv(iv);
-        aes.decrypt(mmtp.payload.data() + 8, static_cast<int>(mmtp.payload.size() - 8), mmtp.payload.data() + 8);
+        context->getCipher(keyType).decrypt(iv, payload.data() + 8, payload.size() - 8, payload.data() + 8);
     }
     else {
-        struct AES_ctx ctx;
-        AES_init_ctx_iv(&ctx, (*key).data(), iv.data());
-        AES_CTR_xcrypt_buffer(&ctx, mmtp.payload.data() + 8, static_cast<int>(mmtp.payload.size() - 8));
+        context->getFallback(keyType).decrypt(iv, payload.data() + 8, payload.size() - 8, payload.data() + 8);
     }
 
+    confirmKey(*context, mmtp);
     return true;
 }
 
+bool AcasHandler::decrypt(std::span<MmtTlv::Mmtp* const> packets, ThreadPool* threadPool) {
+    if (packets.empty()) {
+        return true;
+    }
+
+    auto keyType = packets.front()->extensionHeaderScrambling->encryptionFlag;
+    const KeyContext* context = getKeyContext(keyType);
+    if (!context) {
+        return false;
+    }
+
+    if (!threadPool || packets.size() < kMinParallelPackets) {
+        decryptPackets(*context, keyType, packets);
+        return true;
+    }
+
+    // The IV only depends on the packet itself, so the batch is split into
+    // contiguous chunks. The calling thread takes the first one.
+    size_t chunkSize = (packets.size() + threadPool->size()) / (threadPool->size() + 1);
+    size_t chunkCount = (packets.size() + chunkSize - 1) / chunkSize;
+    // The latch may be destroyed as soon as the last count_down() returns, so
+    // that is the last thing a task does.
+    std::latch remaining(chunkCount - 1);
+    for (size_t i = 1; i < chunkCount; ++i) {
+        auto chunk = packets.subspan(i * chunkSize, std::min(chunkSize, packets.size() - i * chunkSize));
+        threadPool->submit([&, chunk]() {
+            decryptPackets(*context, keyType, chunk);
+            remaining.count_down();
+        });
+    }
+
+    decryptPackets(*context, keyType, packets.first(chunkSize));
+
+    remaining.wait();
+    return true;
+}
+
+void AcasHandler::decryptPackets(const KeyContext& context, MmtTlv::EncryptionFlag keyType, std::span<MmtTlv::Mmtp* const> packets) const {
+    if (hasAESNI) {
+        const AESCtrCipher& cipher = context.getCipher(keyType);
+        for (auto mmtp : packets) {
+            auto payload = mmtp->getWritablePayload();
+            std::array<uint8_t, 16> iv = makeIv(*mmtp);
+            cipher.decrypt(iv, payload.data() + 8, payload.size() - 8, payload.data() + 8);
+        }
+    }
+    else {
+        for (auto mmtp : packets) {
+            auto payload = mmtp->getWritablePayload();
+            std::array<uint8_t, 16> iv = makeIv(*mmtp);
+            context.getFallback(keyType).decrypt(iv, payload.data() + 8, payload.size() - 8, payload.data() + 8);
+        }
+    }
+
+    for (auto mmtp : packets) {
+        if (context.confirmed.load(std::memory_order_relaxed)) {
+            break;
+        }
+        confirmKey(context, *mmtp);
+    }
+}
+
+void AcasHandler::confirmKey(const KeyContext& context, const MmtTlv::Mmtp& mmtp) const {
+    if (context.confirmed.load(std::memory_order_relaxed) || !isRecognizableMfu(mmtp, mmtp.getWritablePayload())) {
+        return;
+    }
+
+    // Only now is the key worth keeping across runs.
+    if (!context.confirmed.exchange(true, std::memory_order_relaxed)) {
+        if (EcmKeyCache* ecmKeyCache = ecmWorker->getEcmKeyCache()) {
+            ecmKeyCache->confirm(context.ecmHash);
+        }
+    }
+}
+
 void AcasHandler::clear() {
     ecmReady = false;
     lastPayloadKeyType = MmtTlv::EncryptionFlag::UNSCRAMBLED;
 
-    std::queue<Task> empty;
+    // ECMs still queued for the old stream are skipped by the worker.
+    generation.fetch_add(1, std::memory_order_relaxed);
     {
         std::unique_lock<std::mutex> lock(queueMutex);
-        queue.swap(empty);
-        queueCv.notify_one();
         queueCv.wait(lock, [&]() {
-            return !processing;
+            return pendingEcms == 0;
         });
     }
     lastEcm.clear();
-    generation.fetch_add(1, std::memory_order_relaxed);
+
+    // Keys of the old stream must not be used for the next one.
+    {
+        std::lock_guard<std::mutex> lock(keyMutex);
+        publishedKey.reset();
+        keyVersion.fetch_add(1, std::memory_order_release);
+    }
 }
 
 void AcasHandler::setSmartCard(std::unique_ptr<ISmartCard> sc) {
-    acasCard->setSmartCard(std::move(sc));
+    ecmWorker->addSmartCard(std::move(sc));
+}
+
+uint64_t AcasHandler::getEcmSequence() const {
+    return ecmSequence.load(std::memory_order_relaxed);
 }
 
-std::optional<std::array<uint8_t, 16>> AcasHandler::getDecryptionKey(MmtTlv::EncryptionFlag keyType) {
+bool AcasHandler::isKeyReady(MmtTlv::EncryptionFlag keyType, uint64_t sequence) {
     if (!ecmReady) {
-        return std::nullopt;
+        return false;
     }
 
-    if (lastPayloadKeyType != keyType) {
-        std::unique_lock<std::mutex> lock(queueMutex);
-        bool ready = queueCv.wait_for(lock, std::chrono::seconds(10), [&]() {
-            return !processing;
-        });
-        if (!ready) {
-            // timeout
-            return std::nullopt;
-        }
+    refreshKey();
+    return canDecrypt(currentKey.get(), keyType, sequence);
+}
+
+bool AcasHandler::waitForKey(MmtTlv::EncryptionFlag keyType, uint64_t sequence, std::chrono::milliseconds timeout) {
+    // Without any ECM there is nothing to wait for.
+    if (!ecmReady) {
+        return false;
     }
 
-    lastPayloadKeyType = keyType;
+    std::unique_lock<std::mutex> lock(keyMutex);
+    return keyCv.wait_for(lock, timeout, [&]() {
+        return canDecrypt(publishedKey.get(), keyType, sequence);
+    });
+}
 
-    {
-        std::lock_guard<std::mutex> lock(keyMutex);
-        if (keyType == MmtTlv::EncryptionFlag::EVEN) {
-            return key.even;
-        }
-        else {
-            return key.odd;
-        }
+bool AcasHandler::canDecrypt(const KeyContext* context, MmtTlv::EncryptionFlag keyType, uint64_t sequence) const {
+    if (!context || context->generation != generation.load(std::memory_order_relaxed)) {
+        return false;
     }
+
+    // The key in use stays valid for its key type until the stream switches
+    // to the other one. A switch needs the key of the latest ECM the packet
+    // may depend on.
+    return keyType == lastPayloadKeyType || context->sequence >= sequence;
 }
 
-void AcasHandler::worker() {
-    while (true) {
-        Task current;
-        {
-            std::unique_lock<std::mutex> lock(queueMutex);
-            queueCv.wait(lock, [&]() {
-                return !queue.empty() || !running;
-            });
+const AcasHandler::KeyContext* AcasHandler::getKeyContext(MmtTlv::EncryptionFlag keyType) {
+    if (!ecmReady) {
+        return nullptr;
+    }
 
-            if (!running) {
-                break;
-            }
+    lastPayloadKeyType = keyType;
+    refreshKey();
 
-            current = std::move(queue.front());
-            queue.pop();
-        }
+    if (!currentKey || currentKey->generation != generation.load(std::memory_order_relaxed)) {
+        return nullptr;
+    }
+    return currentKey.get();
+}
 
-        AcasCard::DecryptionKey key = {};
-        acasCard->ecm(current.second, key);
+void AcasHandler::refreshKey() {
+    if (keyVersion.load(std::memory_order_acquire) != currentKeyVersion) {
+        std::lock_guard<std::mutex> lock(keyMutex);
+        currentKey = publishedKey;
+        currentKeyVersion = keyVersion.load(std::memory_order_relaxed);
+    }
+}
 
-        if (generation.load(std::memory_order_relaxed) == current.first) {
-            std::lock_guard<std::mutex> lock(keyMutex);
-            this->key = key;
-        }
-        {
-            std::lock_guard<std::mutex> lock(queueMutex);
-            if (queue.empty()) {
-                processing = false;
-                queueCv.notify_all();
-            }
+void AcasHandler::onEcmResponse(uint64_t ecmGeneration, uint64_t sequence, const sha256_t& ecmHash, const std::optional<AcasCard::DecryptionKey>& key) {
+    if (key && generation.load(std::memory_order_relaxed) == ecmGeneration) {
+        publishKey(ecmGeneration, sequence, ecmHash, *key);
+    }
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        --pendingEcms;
+        if (pendingEcms == 0) {
+            queueCv.notify_all();
         }
     }
 }
+
+void AcasHandler::publishKey(uint64_t ecmGeneration, uint64_t sequence, const sha256_t& ecmHash, const AcasCard::DecryptionKey& key) {
+    // Expand both keys here, on the worker thread or on a cache hit, so that
+    // the decryption path never does it, not even while odd and even packets
+    // alternate.
+    auto context = std::make_shared<KeyContext>();
+    context->generation = ecmGeneration;
+    context->sequence = sequence;
+    context->ecmHash = ecmHash;
+    if (hasAESNI) {
+        context->odd.setKey(key.odd);
+        context->even.setKey(key.even);
+    }
+    else {
+        context->oddFallback.setKey(key.odd);
+        context->evenFallback.setKey(key.even);
+    }
+
+    std::lock_guard<std::mutex> lock(keyMutex);
+    if (publishedKey && publishedKey->generation == ecmGeneration && publishedKey->sequence > sequence) {
+        return;
+    }
+    publishedKey = std::move(context);
+    keyVersion.fetch_add(1, std::memory_order_release);
+    keyCv.notify_all();
+}
@@ -4,39 +4,87 @@
 #include <queue>
 #include "extensionHeaderScrambling.h"
 #include "acasCard.h"
+#include "acasEcmWorker.h"
 #include "smartCard.h"
 #include "casHandler.h"
 #include "aesCtrCipher.h"
+#include "aesCtrSoftCipher.h"
 
 class AcasHandler : public MmtTlv::CasHandler {
 public:
     AcasHandler();
+    // Shares the ECM worker, its smart cards and its ECM key cache with other handlers.
+    explicit AcasHandler(std::shared_ptr<AcasEcmWorker> ecmWorker);
     ~AcasHandler();
     bool onEcm(const std::vector<uint8_t>& ecm) override;
+    uint64_t getEcmSequence() const override;
+    bool isKeyReady(MmtTlv::EncryptionFlag keyType, uint64_t sequence) override;
+    bool waitForKey(MmtTlv::EncryptionFlag keyType, uint64_t sequence, std::chrono::milliseconds timeout) override;
     bool decrypt(MmtTlv::Mmtp& mmtp) override;
+    bool decrypt(std::span<MmtTlv::Mmtp* const> packets, ThreadPool* threadPool) override;
     void clear() override;
     void setSmartCard(std::unique_ptr<ISmartCard> sc);
 
 private:
-    void worker();
-    std::optional<std::array<uint8_t, 16>> getDecryptionKey(MmtTlv::EncryptionFlag keyType);
+    // The expanded odd and even keys of one ECM response. A context is
+    // built by the ECM worker and never modified once published, so the
+    // decryption path reads it without locking.
+    struct KeyContext {
+        // The handler generation the ECM was submitted in.
+        uint64_t generation{0};
+        // Order of the ECM within the generation. A cache hit can complete
+        // before an earlier ECM sent to the card, whose key must not replace it.
+        uint64_t sequence{0};
+        // The ECM the keys belong to, and whether they have decrypted a
+        // packet that could be recognized, see confirmKey().
+        sha256_t ecmHash{};
+        mutable std::atomic<bool> confirmed{false};
+        AESCtrCipher odd;
+        AESCtrCipher even;
+        // Software ciphers used without AES-NI.
+        AESCtrSoftCipher oddFallback;
+        AESCtrSoftCipher evenFallback;
+
+        const AESCtrCipher& getCipher(MmtTlv::EncryptionFlag keyType) const {
+            return keyType == MmtTlv::EncryptionFlag::EVEN ? even : odd;
+        }
+        const AESCtrSoftCipher& getFallback(MmtTlv::EncryptionFlag keyType) const {
+            return keyType == MmtTlv::EncryptionFlag::EVEN ? evenFallback : oddFallback;
+        }
+    };
+
+    void onEcmResponse(uint64_t ecmGeneration, uint64_t sequence, const sha256_t& ecmHash, const std::optional<AcasCard::DecryptionKey>& key);
+    void publishKey(uint64_t ecmGeneration, uint64_t sequence, const sha256_t& ecmHash, const AcasCard::DecryptionKey& key);
+    void confirmKey(const KeyContext& context, const MmtTlv::Mmtp& mmtp) const;
+    const KeyContext* getKeyContext(MmtTlv::EncryptionFlag keyType);
+    void refreshKey();
+    bool canDecrypt(const KeyContext* context, MmtTlv::EncryptionFlag keyType, uint64_t sequence) const;
+    void decryptPackets(const KeyContext& context, MmtTlv::EncryptionFlag keyType, std::span<MmtTlv::Mmtp* const> packets) const;
 
-    using Task = std::pair<uint64_t, std::vector<uint8_t>>;
     MmtTlv::EncryptionFlag lastPayloadKeyType{ MmtTlv::EncryptionFlag::UNSCRAMBLED };
-    std::queue<Task> queue;
+    std::shared_ptr<AcasEcmWorker> ecmWorker;
     std::condition_variable queueCv;
     std::vector<uint8_t> lastEcm;
+    // Read by the framing stage of PipelinedDemuxer.
+    std::atomic<uint64_t> ecmSequence{0};
     std::mutex queueMutex;
-    std::mutex keyMutex;
-    bool ecmReady{false};
-    std::unique_ptr<AcasCard> acasCard;
-    AcasCard::DecryptionKey key;
-    bool running{true};
-    std::thread workerThread;
-    AESCtrCipher aes;
-    std::array<uint8_t, 16> lastKey{};
+    // Written by the demuxer and read by the decryption path, which runs on
+    // another thread with PipelinedDemuxer.
+    std::atomic<bool> ecmReady{false};
     bool hasAESNI = false;
+
+    // The latest published context, guarded by keyMutex. keyVersion is bumped
+    // on every publication, so the decryption path only takes the lock when
+    // a new context is available. keyCv is notified on every publication.
+    std::mutex keyMutex;
+    std::condition_variable keyCv;
+    std::shared_ptr<const KeyContext> publishedKey;
+    std::atomic<uint64_t> keyVersion{0};
+    // The context in use by the decryption path.
+    std::shared_ptr<const KeyContext> currentKey;
+    uint64_t currentKeyVersion{0};
     std::atomic<uint64_t> generation{0};
-    bool processing{false};
+    // Number of ECMs submitted to the worker that have not completed yet.
+    size_t pendingEcms{0};
 
 };
@@ -0,0 +1,221 @@
+#include "aesCtrCipher.h"
+
+// The wide kernels are compiled for VAES regardless of the global compiler
+// flags and are only called after the CPUID checks below.
+#if defined(_MSC_VER) && !defined(__clang__)
+#define AES_TARGET(features)
+#else
+#define AES_TARGET(features) __attribute__((target(features)))
+#endif
+
+namespace {
+
+struct CpuFeatures {
+    bool vaes256{false};
+    bool vaes512{false};
+};
+
+void cpuid(int info[4], int leaf, int subleaf) {
+#if defined(_MSC_VER)
+    __cpuidex(info, leaf, subleaf);
+#else
+    unsigned int a, b, c, d;
+    __cpuid_count(leaf, subleaf, a, b, c, d);
+    info[0] = a;
+    info[1] = b;
+    info[2] = c;
+    info[3] = d;
+#endif
+}
+
+uint64_t xgetbv0() {
+#if defined(_MSC_VER)
+    return _xgetbv(0);
+#else
+    uint32_t eax, edx;
+    __asm__ __volatile__("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+    return (static_cast<uint64_t>(edx) << 32) | eax;
+#endif
+}
+
+CpuFeatures detectCpuFeatures() {
+    CpuFeatures features;
+    int info[4];
+
+    cpuid(info, 0, 0);
+    if (info[0] < 7) {
+        return features;
+    }
+
+    cpuid(info, 1, 0);
+    bool aesni = (info[2] & (1 << 25)) != 0;
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    if (!aesni || !osxsave) {
+        return features;
+    }
+
+    // The OS has to save the YMM (and for AVX-512 the opmask and ZMM) state.
+    uint64_t xcr0 = xgetbv0();
+    bool ymmState = (xcr0 & 0x06) == 0x06;
+    bool zmmState = (xcr0 & 0xe6) == 0xe6;
+
+    cpuid(info, 7, 0);
+    bool avx2 = (info[1] & (1 << 5)) != 0;
+    bool avx512f = (info[1] & (1 << 16)) != 0;
+    bool avx512bw = (info[1] & (1 << 30)) != 0;
+    bool vaes = (info[2] & (1 << 9)) != 0;
+
+    features.vaes256 = vaes && avx2 && ymmState;
+    features.vaes512 = vaes && avx512f && avx512bw && zmmState;
+    return features;
+}
+
+const CpuFeatures& getCpuFeatures() {
+    static CpuFeatures features = detectCpuFeatures();
+    return features;
+}
+
+}
+
+bool AESCtrCipher::hasVAES256() {
+    return getCpuFeatures().vaes256;
+}
+
+bool AESCtrCipher::hasVAES512() {
+    return getCpuFeatures().vaes512;
+}
+
+// Counters are kept byte-swapped (little-endian) so that a 64-bit add
+// increments them. Like the 128-bit kernel, only the low 64 bits of the
+// counter block are incremented.
+AES_TARGET("aes,vaes,avx2")
+size_t AESCtrCipher::encryptVaes256(const __m128i* roundKeys, __m128i& counter, const uint8_t* src, size_t size, uint8_t* dst) {
+    constexpr size_t kChunkSize = 8 * 16;
+    if (size < kChunkSize) {
+        return 0;
+    }
+
+    __m256i keys[11];
+    for (int iRound = 0; iRound < 11; ++iRound) {
+        keys[iRound] = _mm256_broadcastsi128_si256(roundKeys[iRound]);
+    }
+
+    const __m128i mask128 = _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+    const __m256i mask = _mm256_broadcastsi128_si256(mask128);
+    const __m256i offset0 = _mm256_set_epi64x(0, 1, 0, 0);
+    const __m256i offset1 = _mm256_set_epi64x(0, 3, 0, 2);
+    const __m256i offset2 = _mm256_set_epi64x(0, 5, 0, 4);
+    const __m256i offset3 = _mm256_set_epi64x(0, 7, 0, 6);
+    const __m256i step = _mm256_set_epi64x(0, 8, 0, 8);
+
+    __m256i base = _mm256_shuffle_epi8(_mm256_broadcastsi128_si256(counter), mask);
+
+    size_t i = 0;
+    for (; i + kChunkSize <= size; i += kChunkSize) {
+        __m256i c0 = _mm256_shuffle_epi8(_mm256_add_epi64(base, offset0), mask);
+        __m256i c1 = _mm256_shuffle_epi8(_mm256_add_epi64(base, offset1), mask);
+        __m256i c2 = _mm256_shuffle_epi8(_mm256_add_epi64(base, offset2), mask);
+        __m256i c3 = _mm256_shuffle_epi8(_mm256_add_epi64(base, offset3), mask);
+        base = _mm256_add_epi64(base, step);
+
+        __m256i k = keys[0];
+        c0 = _mm256_xor_si256(c0, k);
+        c1 = _mm256_xor_si256(c1, k);
+        c2 = _mm256_xor_si256(c2, k);
+        c3 = _mm256_xor_si256(c3, k);
+
+        for (int iRound = 1; iRound < 10; ++iRound) {
+            k = keys[iRound];
+            c0 = _mm256_aesenc_epi128(c0, k);
+            c1 = _mm256_aesenc_epi128(c1, k);
+            c2 = _mm256_aesenc_epi128(c2, k);
+            c3 = _mm256_aesenc_epi128(c3, k);
+        }
+
+        k = keys[10];
+        c0 = _mm256_aesenclast_epi128(c0, k);
+        c1 = _mm256_aesenclast_epi128(c1, k);
+        c2 = _mm256_aesenclast_epi128(c2, k);
+        c3 = _mm256_aesenclast_epi128(c3, k);
+
+        __m256i b0 = _mm256_loadu_si256((const __m256i*)(src + i));
+        __m256i b1 = _mm256_loadu_si256((const __m256i*)(src + i + 32));
+        __m256i b2 = _mm256_loadu_si256((const __m256i*)(src + i + 64));
+        __m256i b3 = _mm256_loadu_si256((const __m256i*)(src + i + 96));
+
+        _mm256_storeu_si256((__m256i*)(dst + i), _mm256_xor_si256(b0, c0));
+        _mm256_storeu_si256((__m256i*)(dst + i + 32), _mm256_xor_si256(b1, c1));
+        _mm256_storeu_si256((__m256i*)(dst + i + 64), _mm256_xor_si256(b2, c2));
+        _mm256_storeu_si256((__m256i*)(dst + i + 96), _mm256_xor_si256(b3, c3));
+    }
+
+    counter = _mm_shuffle_epi8(_mm256_castsi256_si128(base), mask128);
+    return i;
+}
+
+AES_TARGET("aes,vaes,avx512f,avx512bw")
+size_t AESCtrCipher::encryptVaes512(const __m128i* roundKeys, __m128i& counter, const uint8_t* src, size_t size, uint8_t* dst) {
+    constexpr size_t kChunkSize = 16 * 16;
+    if (size < kChunkSize) {
+        return 0;
+    }
+
+    // The zero-masked broadcasts/extracts keep GCC from warning about the
+    // undefined upper lanes of the plain intrinsics.
+    __m512i keys[11];
+    for (int iRound = 0; iRound < 11; ++iRound) {
+        keys[iRound] = _mm512_maskz_broadcast_i32x4(0xffff, roundKeys[iRound]);
+    }
+
+    const __m128i mask128 = _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+    const __m512i mask = _mm512_maskz_broadcast_i32x4(0xffff, mask128);
+    const __m512i offset0 = _mm512_set_epi64(0, 3, 0, 2, 0, 1, 0, 0);
+    const __m512i offset1 = _mm512_set_epi64(0, 7, 0, 6, 0, 5, 0, 4);
+    const __m512i offset2 = _mm512_set_epi64(0, 11, 0, 10, 0, 9, 0, 8);
+    const __m512i offset3 = _mm512_set_epi64(0, 15, 0, 14, 0, 13, 0, 12);
+    const __m512i step = _mm512_set_epi64(0, 16, 0, 16, 0, 16, 0, 16);
+
+    __m512i base = _mm512_shuffle_epi8(_mm512_maskz_broadcast_i32x4(0xffff, counter), mask);
+
+    size_t i = 0;
+    for (; i + kChunkSize <= size; i += kChunkSize) {
+        __m512i c0 = _mm512_shuffle_epi8(_mm512_add_epi64(base, offset0), mask);
+        __m512i c1 = _mm512_shuffle_epi8(_mm512_add_epi64(base, offset1), mask);
+        __m512i c2 = _mm512_shuffle_epi8(_mm512_add_epi64(base, offset2), mask);
+        __m512i c3 = _mm512_shuffle_epi8(_mm512_add_epi64(base, offset3), mask);
+        base = _mm512_add_epi64(base, step);
+
+        __m512i k = keys[0];
+        c0 = _mm512_xor_si512(c0, k);
+        c1 = _mm512_xor_si512(c1, k);
+        c2 = _mm512_xor_si512(c2, k);
+        c3 = _mm512_xor_si512(c3, k);
+
+        for (int iRound = 1; iRound < 10; ++iRound) {
+            k = keys[iRound];
+            c0 = _mm512_aesenc_epi128(c0, k);
+            c1 = _mm512_aesenc_epi128(c1, k);
+            c2 = _mm512_aesenc_epi128(c2, k);
+            c3 = _mm512_aesenc_epi128(c3, k);
+        }
+
+        k = keys[10];
+        c0 = _mm512_aesenclast_epi128(c0, k);
+        c1 = _mm512_aesenclast_epi128(c1, k);
+        c2 = _mm512_aesenclast_epi128(c2, k);
+        c3 = _mm512_aesenclast_epi128(c3, k);
+
+        __m512i b0 = _mm512_loadu_si512((const void*)(src + i));
+        __m512i b1 = _mm512_loadu_si512((const void*)(src + i + 64));
+        __m512i b2 = _mm512_loadu_si512((const void*)(src + i + 128));
+        __m512i b3 = _mm512_loadu_si512((const void*)(src + i + 192));
+
+        _mm512_storeu_si512((void*)(dst + i), _mm512_xor_si512(b0, c0));
+        _mm512_storeu_si512((void*)(dst + i + 64), _mm512_xor_si512(b1, c1));
+        _mm512_storeu_si512((void*)(dst + i + 128), _mm512_xor_si512(b2, c2));
+        _mm512_storeu_si512((void*)(dst + i + 192), _mm512_xor_si512(b3, c3));
+    }
+
+    counter = _mm_shuffle_epi8(_mm512_maskz_extracti32x4_epi32(0xf, base, 0), mask128);
+    return i;
+}
@@ -5,6 +5,8 @@
 #include <immintrin.h>
 #include <tmmintrin.h>
 #include <stdexcept>
+#include <string>
+#include <cstring>
 #if defined(_MSC_VER)
 #include <intrin.h>
 #else
@@ -13,6 +15,14 @@
 
 class AESCtrCipher {
 public:
+    // Interleaved AES-NI kernels. AesNi runs four 128-bit blocks at a time,
+    // Vaes256 and Vaes512 run 8 and 16 blocks on 256/512-bit VAES registers.
+    enum class Kernel {
+        AesNi,
+        Vaes256,
+        Vaes512,
+    };
+
     AESCtrCipher() = default;
 
     void setKey(const std::array<uint8_t, 16>& newKey) {
@@ -38,11 +48,70 @@ public:
         return result;
     }
 
+    // VAES with AVX2, and VAES with AVX-512F/BW, including OS support for the wider registers.
+    static bool hasVAES256();
+    static bool hasVAES512();
+
+    static bool isSupported(Kernel kernel) {
+        switch (kernel) {
+        case Kernel::AesNi:
+            return hasAESNI();
+        case Kernel::Vaes256:
+            return hasVAES256();
+        case Kernel::Vaes512:
+            return hasVAES512();
+        }
+        return false;
+    }
+
+    // The widest kernel the CPU supports.
+    static Kernel bestKernel() {
+        static Kernel result = []() {
+            if (hasVAES512()) {
+                return Kernel::Vaes512;
+            }
+            if (hasVAES256()) {
+                return Kernel::Vaes256;
+            }
+            return Kernel::AesNi;
+        }();
+        return result;
+    }
+
+    static const char* getKernelName(Kernel kernel) {
+        switch (kernel) {
+        case Kernel::AesNi:
+            return "aesni";
+        case Kernel::Vaes256:
+            return "vaes256";
+        case Kernel::Vaes512:
+            return "vaes512";
+        }
+        return "unknown";
+    }
+
+    Kernel getKernel() const {
+        return kernel;
+    }
+
+    void setKernel(Kernel kernel) {
+        if (!isSupported(kernel)) {
+            throw std::runtime_error(std::string("CPU does not support the AES kernel: ") + getKernelName(kernel));
+        }
+        this->kernel = kernel;
+    }
+
     void setIv(std::array<uint8_t, 16> iv) {
         this->iv = iv;
     }
 
     void encrypt(uint8_t* src, size_t size, uint8_t* dst) const {
+        encrypt(iv, src, size, dst);
+    }
+
+    // Takes the IV as an argument instead of using setIv(), so that a cipher
+    // whose key is set can be shared by several threads.
+    void encrypt(const std::array<uint8_t, 16>& iv, uint8_t* src, size_t size, uint8_t* dst) const {
         __m128i counter = _mm_loadu_si128((const __m128i*)iv.data());
         const __m128i mask = _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
         const __m128i one_le = _mm_set_epi32(0, 0, 0, 1);
@@ -56,8 +125,15 @@ public:
         const __m128i three_be = _mm_set_epi8(3, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
         const __m128i four_be = _mm_set_epi8(4, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
 
+        // The wide kernels take whole 8/16 block chunks, the rest falls through to the loops below.
         uint64_t i = 0;
-        int low_byte = iv[15];
+        if (kernel == Kernel::Vaes512) {
+            i = encryptVaes512(roundKeys, counter, src, size, dst);
+        }
+        else if (kernel == Kernel::Vaes256) {
+            i = encryptVaes256(roundKeys, counter, src, size, dst);
+        }
+        int low_byte = _mm_extract_epi8(counter, 15);
 
         for (; i + 64 <= size; i += 64) {
             __m128i c0 = counter;
@@ -127,7 +203,16 @@ public:
         return encrypt(src, size, dst);
     }
 
+    void decrypt(const std::array<uint8_t, 16>& iv, uint8_t* src, size_t size, uint8_t* dst) const {
+        return encrypt(iv, src, size, dst);
+    }
+
 private:
+    // Process whole chunks of 8 or 16 blocks and return the number of bytes
+    // processed. counter is advanced past the processed blocks.
+    static size_t encryptVaes256(const __m128i* roundKeys, __m128i& counter, const uint8_t* src, size_t size, uint8_t* dst);
+    static size_t encryptVaes512(const __m128i* roundKeys, __m128i& counter, const uint8_t* src, size_t size, uint8_t* dst);
+
     template<uint8_t rcon>
     inline __m128i expandRound(__m128i temp1) const {
         __m128i temp2 = _mm_aeskeygenassist_si128(temp1, rcon);
@@ -196,4 +281,5 @@ private:
     std::array<uint8_t, 16> key{};
     std::array<uint8_t, 16> iv;
     __m128i roundKeys[11];
+    Kernel kernel{bestKernel()};
 };
@@ -0,0 +1,158 @@
+#include "aesCtrSoftCipher.h"
+
+namespace {
+
+// S-box and the four round tables (SubBytes, ShiftRows and MixColumns in one
+// lookup per byte), built from the field arithmetic on first use.
+struct Tables {
+    uint8_t sbox[256];
+    uint32_t te[4][256];
+};
+
+uint8_t rotl8(uint8_t x, int shift) {
+    return static_cast<uint8_t>((x << shift) | (x >> (8 - shift)));
+}
+
+uint8_t xtime(uint8_t x) {
+    return static_cast<uint8_t>((x << 1) ^ ((x & 0x80) ? 0x1b : 0));
+}
+
+uint32_t rotr32(uint32_t x, int shift) {
+    return (x >> shift) | (x << (32 - shift));
+}
+
+Tables makeTables() {
+    Tables tables{};
+
+    // Walk the multiplicative group with generator 3 and its inverse at the same time.
+    uint8_t p = 1;
+    uint8_t q = 1;
+    do {
+        p = static_cast<uint8_t>(p ^ xtime(p));
+
+        q ^= q << 1;
+        q ^= q << 2;
+        q ^= q << 4;
+        if (q & 0x80) {
+            q ^= 0x09;
+        }
+
+        uint8_t affine = q ^ rotl8(q, 1) ^ rotl8(q, 2) ^ rotl8(q, 3) ^ rotl8(q, 4);
+        tables.sbox[p] = affine ^ 0x63;
+    } while (p != 1);
+    tables.sbox[0] = 0x63;
+
+    for (int i = 0; i < 256; ++i) {
+        uint8_t s = tables.sbox[i];
+        uint8_t s2 = xtime(s);
+        uint8_t s3 = s2 ^ s;
+        uint32_t word = (static_cast<uint32_t>(s2) << 24) | (static_cast<uint32_t>(s) << 16) | (static_cast<uint32_t>(s) << 8) | s3;
+        tables.te[0][i] = word;
+        tables.te[1][i] = rotr32(word, 8);
+        tables.te[2][i] = rotr32(word, 16);
+        tables.te[3][i] = rotr32(word, 24);
+    }
+    return tables;
+}
+
+const Tables& getTables() {
+    static const Tables tables = makeTables();
+    return tables;
+}
+
+uint32_t loadBe32(const uint8_t* p) {
+    return (static_cast<uint32_t>(p[0]) << 24) | (static_cast<uint32_t>(p[1]) << 16) | (static_cast<uint32_t>(p[2]) << 8) | p[3];
+}
+
+void storeBe32(uint8_t* p, uint32_t value) {
+    p[0] = static_cast<uint8_t>(value >> 24);
+    p[1] = static_cast<uint8_t>(value >> 16);
+    p[2] = static_cast<uint8_t>(value >> 8);
+    p[3] = static_cast<uint8_t>(value);
+}
+
+}
+
+void AESCtrSoftCipher::setKey(const std::array<uint8_t, 16>& key) {
+    const Tables& tables = getTables();
+    auto subWord = [&](uint32_t word) {
+        return (static_cast<uint32_t>(tables.sbox[word >> 24]) << 24)
+            | (static_cast<uint32_t>(tables.sbox[(word >> 16) & 0xff]) << 16)
+            | (static_cast<uint32_t>(tables.sbox[(word >> 8) & 0xff]) << 8)
+            | tables.sbox[word & 0xff];
+    };
+
+    for (int i = 0; i < 4; ++i) {
+        roundKeys[i] = loadBe32(key.data() + i * 4);
+    }
+
+    uint8_t rcon = 1;
+    for (int i = 4; i < 44; ++i) {
+        uint32_t temp = roundKeys[i - 1];
+        if (i % 4 == 0) {
+            temp = subWord((temp << 8) | (temp >> 24)) ^ (static_cast<uint32_t>(rcon) << 24);
+            rcon = xtime(rcon);
+        }
+        roundKeys[i] = roundKeys[i - 4] ^ temp;
+    }
+}
+
+void AESCtrSoftCipher::encryptBlock(const uint8_t* in, uint8_t* out) const {
+    const Tables& tables = getTables();
+    const auto& te0 = tables.te[0];
+    const auto& te1 = tables.te[1];
+    const auto& te2 = tables.te[2];
+    const auto& te3 = tables.te[3];
+    const uint32_t* rk = roundKeys.data();
+
+    uint32_t s0 = loadBe32(in) ^ rk[0];
+    uint32_t s1 = loadBe32(in + 4) ^ rk[1];
+    uint32_t s2 = loadBe32(in + 8) ^ rk[2];
+    uint32_t s3 = loadBe32(in + 12) ^ rk[3];
+
+    for (int round = 1; round < 10; ++round) {
+        rk += 4;
+        uint32_t t0 = te0[s0 >> 24] ^ te1[(s1 >> 16) & 0xff] ^ te2[(s2 >> 8) & 0xff] ^ te3[s3 & 0xff] ^ rk[0];
+        uint32_t t1 = te0[s1 >> 24] ^ te1[(s2 >> 16) & 0xff] ^ te2[(s3 >> 8) & 0xff] ^ te3[s0 & 0xff] ^ rk[1];
+        uint32_t t2 = te0[s2 >> 24] ^ te1[(s3 >> 16) & 0xff] ^ te2[(s0 >> 8) & 0xff] ^ te3[s1 & 0xff] ^ rk[2];
+        uint32_t t3 = te0[s3 >> 24] ^ te1[(s0 >> 16) & 0xff] ^ te2[(s1 >> 8) & 0xff] ^ te3[s2 & 0xff] ^ rk[3];
+        s0 = t0;
+        s1 = t1;
+        s2 = t2;
+        s3 = t3;
+    }
+
+    // The last round has no MixColumns.
+    rk += 4;
+    const uint8_t* sbox = tables.sbox;
+    auto lastRound = [&](uint32_t a, uint32_t b, uint32_t c, uint32_t d, uint32_t key) {
+        return ((static_cast<uint32_t>(sbox[a >> 24]) << 24)
+            | (static_cast<uint32_t>(sbox[(b >> 16) & 0xff]) << 16)
+            | (static_cast<uint32_t>(sbox[(c >> 8) & 0xff]) << 8)
+            | sbox[d & 0xff]) ^ key;
+    };
+    storeBe32(out, lastRound(s0, s1, s2, s3, rk[0]));
+    storeBe32(out + 4, lastRound(s1, s2, s3, s0, rk[1]));
+    storeBe32(out + 8, lastRound(s2, s3, s0, s1, rk[2]));
+    storeBe32(out + 12, lastRound(s3, s0, s1, s2, rk[3]));
+}
+
+void AESCtrSoftCipher::encrypt(const std::array<uint8_t, 16>& iv, uint8_t* src, size_t size, uint8_t* dst) const {
+    std::array<uint8_t, 16> counter = iv;
+    uint8_t keyStream[16];
+
+    for (size_t i = 0; i < size; i += 16) {
+        encryptBlock(counter.data(), keyStream);
+
+        size_t length = size - i < 16 ? size - i : 16;
+        for (size_t j = 0; j < length; ++j) {
+            dst[i + j] = src[i + j] ^ keyStream[j];
+        }
+
+        for (int j = 15; j >= 0; --j) {
+            if (++counter[j] != 0) {
+                break;
+            }
+        }
+    }
+}
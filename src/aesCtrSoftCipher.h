@@ -0,0 +1,26 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+// Portable table-based AES-128-CTR for CPUs without AES-NI. The key schedule
+// is expanded once by setKey() and the cipher is const afterwards, so one
+// instance can be shared by several threads.
+// Unlike AESCtrCipher, the counter is incremented over all 128 bits, the
+// same as tiny-AES.
+class AESCtrSoftCipher {
+public:
+    AESCtrSoftCipher() = default;
+
+    void setKey(const std::array<uint8_t, 16>& key);
+    void encrypt(const std::array<uint8_t, 16>& iv, uint8_t* src, size_t size, uint8_t* dst) const;
+
+    void decrypt(const std::array<uint8_t, 16>& iv, uint8_t* src, size_t size, uint8_t* dst) const {
+        encrypt(iv, src, size, dst);
+    }
+
+private:
+    void encryptBlock(const uint8_t* in, uint8_t* out) const;
+
+    std::array<uint32_t, 44> roundKeys{};
+};
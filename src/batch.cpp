@@ -0,0 +1,91 @@
+#include "batch.h"
+#include <algorithm>
+#include <cctype>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+namespace {
+
+bool isMmtsFile(const std::filesystem::path& path) {
+    std::string extension = path.extension().string();
+    std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) {
+        return static_cast<char>(std::tolower(c));
+    });
+    return extension == ".mmts";
+}
+
+std::optional<std::vector<BatchJob>> listDirectory(const std::filesystem::path& directory, const std::string& outputDir) {
+    std::filesystem::path outputDirectory = outputDir.empty() ? directory : std::filesystem::path(outputDir);
+
+    std::error_code ec;
+    std::filesystem::create_directories(outputDirectory, ec);
+    if (ec) {
+        std::cerr << "Unable to create output directory: " << outputDirectory.string() << std::endl;
+        return std::nullopt;
+    }
+
+    std::vector<BatchJob> jobs;
+    for (const auto& entry : std::filesystem::directory_iterator(directory, ec)) {
+        if (!entry.is_regular_file() || !isMmtsFile(entry.path())) {
+            continue;
+        }
+
+        std::filesystem::path output = outputDirectory / entry.path().filename();
+        output.replace_extension(".ts");
+        jobs.push_back({ entry.path().string(), output.string() });
+    }
+    if (ec) {
+        std::cerr << "Unable to read directory: " << directory.string() << std::endl;
+        return std::nullopt;
+    }
+
+    std::sort(jobs.begin(), jobs.end(), [](const BatchJob& a, const BatchJob& b) {
+        return a.input < b.input;
+    });
+    return jobs;
+}
+
+std::optional<std::vector<BatchJob>> readList(const std::string& path) {
+    std::ifstream fs(path);
+    if (!fs.is_open()) {
+        std::cerr << "Unable to open batch list: " << path << std::endl;
+        return std::nullopt;
+    }
+
+    std::vector<BatchJob> jobs;
+    std::string line;
+    size_t lineNumber = 0;
+    while (std::getline(fs, line)) {
+        ++lineNumber;
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+
+        size_t tab = line.find('\t');
+        if (tab == std::string::npos || tab == 0 || tab + 1 == line.size()) {
+            std::cerr << "Invalid batch list entry at line " << lineNumber << ": " << line << std::endl;
+            return std::nullopt;
+        }
+        BatchJob job{ line.substr(0, tab), line.substr(tab + 1) };
+        if (job.input == job.output) {
+            std::cerr << "Input and output paths cannot be the same at line " << lineNumber << ": " << line << std::endl;
+            return std::nullopt;
+        }
+        jobs.push_back(std::move(job));
+    }
+    return jobs;
+}
+
+}
+
+std::optional<std::vector<BatchJob>> loadBatchJobs(const std::string& path, const std::string& outputDir) {
+    std::error_code ec;
+    if (std::filesystem::is_directory(path, ec)) {
+        return listDirectory(path, outputDir);
+    }
+    return readList(path);
+}
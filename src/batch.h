@@ -0,0 +1,16 @@
+#pragma once
+#include <optional>
+#include <string>
+#include <vector>
+
+struct BatchJob {
+    std::string input;
+    std::string output;
+};
+
+// Builds the job list for batch conversion. path is either a directory, whose
+// *.mmts files are converted to <outputDir>/<name>.ts (outputDir defaults to
+// the directory itself), or a text file with one "input<TAB>output" pair per
+// line. Empty lines and lines starting with '#' are skipped.
+// Returns std::nullopt after printing the reason if the jobs cannot be listed.
+std::optional<std::vector<BatchJob>> loadBatchJobs(const std::string& path, const std::string& outputDir);
@@ -11,8 +11,9 @@ public:
     MmtTlv::MmtTlvDemuxer demuxer;
     RemuxerHandler handler{demuxer};
     std::vector<uint8_t> remuxOutput;
+    VectorOutput remuxSink{remuxOutput};
     std::unique_ptr<std::ofstream> mmtsDumpFs;
 
 };
 
-extern BonDriverContext g_bonDriverContext;
\ No newline at end of file
+extern BonDriverContext g_bonDriverContext;
\ No newline at end of file
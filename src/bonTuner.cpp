@@ -6,7 +6,6 @@
 
 namespace {
 
-std::vector<uint8_t> inputBuffer;
 std::vector<uint8_t> outputBuffer;
 
 }
@@ -87,21 +86,26 @@ const bool CBonTuner::GetTsStream(uint8_t** ppDst, uint32_t* pdwSize, uint32_t*
 			if (g_bonDriverContext.mmtsDumpFs) {
                 g_bonDriverContext.mmtsDumpFs->write((char*)*ppDst, *pdwSize);
 			}
-		
-			inputBuffer.insert(inputBuffer.end(), *ppDst, *ppDst + *pdwSize);
+
+			const uint8_t* src = *ppDst;
+			size_t left = *pdwSize;
+			while (left > 0) {
+				std::span<uint8_t> dst = inputRing.prepare(left);
+				if (dst.empty()) {
+					// The ring is full, drain it before staging the rest
+					demuxInput();
+					continue;
+				}
+
+				memcpy(dst.data(), src, dst.size());
+				inputRing.commit(dst.size());
+				src += dst.size();
+				left -= dst.size();
+			}
 		}
 	} while(ret && *pdwRemain != 0);
 	
-	MmtTlv::Common::ReadStream input(inputBuffer);
-	while (!input.isEof()) {
-		MmtTlv::DemuxStatus status = g_bonDriverContext.demuxer.demux(input);
-
-		if (status == MmtTlv::DemuxStatus::NotEnoughBuffer) {
-			break;
-		}
-	}
-
-	inputBuffer.erase(inputBuffer.begin(), inputBuffer.begin() + (inputBuffer.size() - input.leftBytes()));
+	demuxInput();
 
 	if (g_bonDriverContext.remuxOutput.size() < 188 * 1024) {
 		return false;
@@ -115,10 +119,23 @@ const bool CBonTuner::GetTsStream(uint8_t** ppDst, uint32_t* pdwSize, uint32_t*
 	return true;
 }
 
+void CBonTuner::demuxInput() {
+	MmtTlv::Common::ReadStream input(inputRing.data());
+	while (!input.isEof()) {
+		MmtTlv::DemuxStatus status = g_bonDriverContext.demuxer.demux(input);
+
+		if (status == MmtTlv::DemuxStatus::NotEnoughBuffer) {
+			break;
+		}
+	}
+
+	inputRing.consume(inputRing.size() - input.leftBytes());
+}
+
 void CBonTuner::PurgeTsStream(void) {
 	std::lock_guard<std::mutex> lock(mutex);
 
-	inputBuffer.clear();
+	inputRing.clear();
 	g_bonDriverContext.remuxOutput.clear();
 	g_bonDriverContext.demuxer.clear();
 
@@ -144,7 +161,7 @@ const char* CBonTuner::EnumChannelName(const uint32_t dwSpace, const uint32_t dw
 const bool CBonTuner::SetChannel(const uint32_t dwSpace, const uint32_t dwChannel) {
 	std::lock_guard<std::mutex> lock(mutex);
 
-	inputBuffer.clear();
+	inputRing.clear();
 	g_bonDriverContext.remuxOutput.clear();
 	g_bonDriverContext.demuxer.clear();
 
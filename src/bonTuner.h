@@ -3,6 +3,7 @@
 #include <mutex>
 #include "IBonDriver2.h"
 #include "config.h"
+#include "inputRing.h"
 
 class CBonTuner : public IBonDriver2
 {
@@ -42,7 +43,11 @@ public:
 	void Release(void);
 
 protected:
+	void demuxInput();
+
+	static constexpr size_t kInputRingSize = 8 * 1024 * 1024;
+
 	IBonDriver2* pBonDriver2;
-	std::vector<uint8_t> inputBuffer;
+	InputRing inputRing{kInputRingSize};
 	std::mutex mutex;
 };
\ No newline at end of file
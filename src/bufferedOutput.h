@@ -1,7 +1,10 @@
+#pragma once
+#include <cstring>
 #include <iostream>
 #include <vector>
+#include "output.h"
 
-class BufferedOutput {
+class BufferedOutput : public IOutput {
 public:
     explicit BufferedOutput(std::ostream& stream)
         : stream_(stream), offset_(0) {
@@ -12,7 +15,7 @@ public:
         flush();
     }
 
-    void write(const uint8_t* data, size_t size) {
+    void write(const uint8_t* data, size_t size) override {
         if (offset_ + size > BUFFER_SIZE) {
             flush();
         }
@@ -20,11 +23,27 @@ public:
         offset_ += size;
     }
 
-    void flush() {
+    std::span<uint8_t> reserve(size_t size) override {
+        if (offset_ + size > BUFFER_SIZE) {
+            flush();
+        }
+        return { buffer_.data() + offset_, size };
+    }
+
+    void commit(size_t size) override {
+        offset_ += size;
+    }
+
+    void flush() override {
         if (offset_ > 0) {
             stream_.write(reinterpret_cast<const char*>(buffer_.data()), offset_);
             offset_ = 0;
         }
+        stream_.flush();
+    }
+
+    bool hasFailed() const override {
+        return stream_.fail();
     }
 
 private:
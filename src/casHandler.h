@@ -1,7 +1,11 @@
 #pragma once
+#include <chrono>
+#include <span>
 #include <vector>
 #include "mmtp.h"
 
+class ThreadPool;
+
 namespace MmtTlv {
 	
 class CasHandler {
@@ -9,7 +13,31 @@ public:
 	virtual ~CasHandler() = default;
 
 	virtual bool onEcm(const std::vector<uint8_t>& ecm) { return false; }
+	// Identifies the latest ECM passed to onEcm(). Scrambled packets are
+	// tagged with it when they have to wait for a key.
+	virtual uint64_t getEcmSequence() const { return 0; }
+	// Returns true if decrypt() has a key for a packet of this key type that
+	// arrived when ecmSequence was the latest ECM. Never waits.
+	virtual bool isKeyReady(EncryptionFlag keyType, uint64_t ecmSequence) { return true; }
+	// Waits until isKeyReady() holds or the timeout expires.
+	virtual bool waitForKey(EncryptionFlag keyType, uint64_t ecmSequence, std::chrono::milliseconds timeout) {
+		return isKeyReady(keyType, ecmSequence);
+	}
+	// Decrypts with the key available now. Callers check isKeyReady() first.
+	// The payload is decrypted in place and has to be writable, see
+	// Mmtp::getWritablePayload().
 	virtual bool decrypt(MmtTlv::Mmtp& mmt) { return false; }
+	// Decrypts packets that share one key type. Each packet is decrypted
+	// independently, so implementations may interleave them and spread the
+	// work over threadPool, if given. Returns false if no key is available.
+	virtual bool decrypt(std::span<MmtTlv::Mmtp* const> packets, ThreadPool* threadPool) {
+		for (auto mmtp : packets) {
+			if (!decrypt(*mmtp)) {
+				return false;
+			}
+		}
+		return true;
+	}
 	virtual void clear() {}
 
 };
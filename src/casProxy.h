@@ -99,6 +99,12 @@ enum class Opcode : uint32_t {
     SCardTransmitRes,
     SCardGetAttribReq,
     SCardGetAttribRes,
+
+    // ACAS requests. The proxy runs the A0 authentication and the ECM exchange
+    // next to the card and returns only the key material, so an ECM costs one
+    // round trip instead of one per APDU and transaction call.
+    AcasEcmReq = 0x1001,
+    AcasEcmRes,
 };
 
 class StreamWriter {
@@ -562,6 +568,32 @@ protected:
 
 };
 
+class AcasEcmRequest : public TypedRequest<Opcode::AcasEcmReq> {
+public:
+    // Reader of the card to use, empty for the proxy's default reader.
+    std::string szReader;
+    std::vector<uint8_t> ecm;
+
+protected:
+    virtual bool unpackPayload(StreamReader& reader) {
+        if (!reader.readBe(szReader)) {
+            return false;
+        }
+        if (!reader.readBe(ecm)) {
+            return false;
+        }
+        if (reader.remaining() > 0) {
+            return false;
+        }
+        return true;
+    }
+
+    virtual void packPayload(StreamWriter& writer) const {
+        writer.writeBe(szReader);
+        writer.writeBe(ecm);
+    }
+
+};
 
 class ResponseBase {
 public:
@@ -838,6 +870,37 @@ protected:
 
 };
 
+class AcasEcmResponse : public TypedResponse<Opcode::AcasEcmRes> {
+public:
+    uint32_t apiReturn{0};
+    // Status word of the ECM response of the card.
+    uint32_t sw{0};
+    // Odd key followed by even key, empty if the card rejected the ECM.
+    std::vector<uint8_t> key;
+
+protected:
+    virtual bool unpackPayload(StreamReader& reader) {
+        if (!reader.readBe(apiReturn)) {
+            return false;
+        }
+        if (!reader.readBe(sw)) {
+            return false;
+        }
+        if (!reader.readBe(key)) {
+            return false;
+        }
+
+        return true;
+    }
+
+    virtual void packPayload(StreamWriter& writer) const {
+        writer.writeBe(apiReturn);
+        writer.writeBe(sw);
+        writer.writeBe(key);
+    }
+
+};
+
 class ResponseFactory {
 public:
     static std::shared_ptr<ResponseBase> create(Opcode opcode) {
@@ -859,6 +922,7 @@ private:
         { Opcode::SCardEndTransactionRes,		[]{ return std::make_shared<SCardEndTransactionResponse>(); } },
         { Opcode::SCardTransmitRes,			    []{ return std::make_shared<SCardTransmitResponse>(); } },
         { Opcode::SCardGetAttribRes,			[]{ return std::make_shared<SCardGetAttribResponse>(); } },
+        { Opcode::AcasEcmRes,			        []{ return std::make_shared<AcasEcmResponse>(); } },
     };
 };
 
@@ -1,7 +1,7 @@
 #include "casProxyClient.h"
 
 CasProxyClient::CasProxyClient(const std::string& host, uint16_t port)
-    : host(host), port(port), resolver(io_context), socket(io_context), connectionTimer(io_context), workGuard(asio::make_work_guard(io_context)) {
+    : host(host), port(port), workGuard(asio::make_work_guard(io_context)), resolver(io_context), socket(io_context), connectSignal(io_context) {
     thread = std::thread([this]() { io_context.run(); });
 }
 
@@ -14,112 +14,156 @@ CasProxyClient::~CasProxyClient() {
 }
 
 void CasProxyClient::connect() {
-    std::lock_guard<std::mutex> lock(connectionMutex);
-    if (connecting) {
+    asio::co_spawn(io_context, [this]() -> asio::awaitable<void> {
+        co_await ensureConnected();
+    }, asio::detached);
+}
+
+bool CasProxyClient::waitConnected() {
+    if (closed) {
+        return false;
+    }
+
+    return asio::co_spawn(io_context, ensureConnected(), asio::use_future).get();
+}
+
+void CasProxyClient::close() {
+    if (closed.exchange(true)) {
         return;
     }
 
-    connecting = true;
-    connectionTimer.expires_after(std::chrono::milliseconds(kConnectionTimeoutMs));
-    connectionTimer.async_wait([&](const std::error_code& error) {
-        if (!error && !connected) {
-            onFail();
-        }
+    // The thread stops once the coroutines have seen the socket close.
+    asio::post(io_context, [this]() {
+        resolver.cancel();
+        disconnect();
+        connectSignal.cancel();
     });
+    workGuard.reset();
+}
 
-    asio::ip::tcp::resolver::query query(host, std::to_string(port));
-    resolver.async_resolve(query,
-        [this](std::error_code ec, asio::ip::tcp::resolver::results_type results) {
-            if (!ec) {
-                asio::async_connect(socket, results,
-                    [this](std::error_code ec, const asio::ip::tcp::endpoint&) {
-                        connectionTimer.cancel();
-                        if (!ec) {
-                            onOpen();
-                            doRead();
-                        }
-                        else {
-                            onFail();
-                        }
-                    });
-            }
-            else {
-                connectionTimer.cancel();
-                onFail();
-            }
+asio::awaitable<bool> CasProxyClient::ensureConnected() {
+    if (state == State::Connected) {
+        co_return true;
+    }
+
+    if (state == State::Connecting) {
+        // Another request is connecting, wait for it.
+        asio::error_code ec;
+        co_await connectSignal.async_wait(asio::redirect_error(asio::use_awaitable, ec));
+        co_return state == State::Connected;
+    }
+
+    if (closed) {
+        co_return false;
+    }
+
+    state = State::Connecting;
+    connectSignal.expires_at(asio::steady_timer::time_point::max());
+
+    asio::steady_timer timeout(io_context, std::chrono::milliseconds(kConnectionTimeoutMs));
+    timeout.async_wait([this](const asio::error_code& ec) {
+        if (!ec) {
+            resolver.cancel();
+            asio::error_code ignored;
+            socket.close(ignored);
         }
-    );
-}
+    });
 
-void CasProxyClient::close() {
-    for (auto& promise : mapResponsePromise) {
-        promise.second.set_value(nullptr);
+    asio::error_code ec;
+    auto results = co_await resolver.async_resolve(host, std::to_string(port), asio::redirect_error(asio::use_awaitable, ec));
+    if (!ec) {
+        co_await asio::async_connect(socket, results, asio::redirect_error(asio::use_awaitable, ec));
     }
-    mapResponsePromise.clear();
+    timeout.cancel();
 
-    std::deque<std::vector<uint8_t>> empty;
-    sendQueue.swap(empty);
+    if (ec || closed) {
+        asio::error_code ignored;
+        socket.close(ignored);
+        state = State::Disconnected;
+    }
+    else {
+        socket.set_option(asio::ip::tcp::no_delay(true), ec);
+        state = State::Connected;
+        asio::co_spawn(io_context, doRead(), asio::detached);
+    }
+
+    connectSignal.cancel();
+    co_return state == State::Connected;
+}
 
+void CasProxyClient::disconnect() {
     if (socket.is_open()) {
-        asio::error_code ec;
-        socket.cancel(ec);
-        socket.close(ec);
+        asio::error_code ignored;
+        socket.cancel(ignored);
+        socket.close(ignored);
     }
+    state = State::Disconnected;
 
-    connectionTimer.cancel();
-
-    workGuard.reset();
-    io_context.stop();
+    // The writer still owns the front of the queue, it clears the rest once
+    // its write is aborted.
+    if (!writing) {
+        sendQueue.clear();
+    }
 
-    std::lock_guard<std::mutex> lock(connectionMutex);
-    connected = false;
-    connecting = false;
+    for (auto& pending : pendingRequests) {
+        pending.second->signal.cancel();
+    }
+    pendingRequests.clear();
 }
 
-void CasProxyClient::doRead() {
-    asio::async_read(socket, asio::buffer(&packetLength, 4),
-        [this](std::error_code ec, std::size_t) {
-            if (!ec) {
-                packetLength = casproxy::swapEndian32(packetLength);
-                if (packetLength > 100 * 1024) {
-                    return;
-                }
+asio::awaitable<void> CasProxyClient::doRead() {
+    std::vector<uint8_t> packetData;
+    while (true) {
+        asio::error_code ec;
+        uint32_t packetLength;
+        co_await asio::async_read(socket, asio::buffer(&packetLength, 4), asio::redirect_error(asio::use_awaitable, ec));
+        if (ec) {
+            break;
+        }
 
-                readPacketData();
-            }
-            else if (ec != asio::error::eof) {
-                close();
-            }
+        packetLength = casproxy::swapEndian32(packetLength);
+        if (packetLength > kMaxPacketLength) {
+            break;
+        }
+
+        packetData.resize(packetLength);
+        co_await asio::async_read(socket, asio::buffer(packetData), asio::redirect_error(asio::use_awaitable, ec));
+        if (ec) {
+            break;
         }
-    );
+
+        handleResponse(packetData);
+    }
+
+    if (state == State::Connected) {
+        disconnect();
+    }
 }
 
-void CasProxyClient::readPacketData() {
-    packetData.resize(packetLength);
-    asio::async_read(socket, asio::buffer(packetData),
-        [this](std::error_code ec, std::size_t) {
-            if (!ec) {
-                handleResponse();
-                doRead();
-            }
-            else if (ec != asio::error::eof) {
-                close();
-            }
+asio::awaitable<void> CasProxyClient::doWrite() {
+    while (!sendQueue.empty()) {
+        asio::error_code ec;
+        co_await asio::async_write(socket, asio::buffer(sendQueue.front()), asio::redirect_error(asio::use_awaitable, ec));
+        if (ec) {
+            sendQueue.clear();
+            disconnect();
+            break;
         }
-    );
+
+        sendQueue.pop_front();
+    }
+
+    writing = false;
 }
 
-void CasProxyClient::handleResponse() {
+void CasProxyClient::handleResponse(const std::vector<uint8_t>& packetData) {
     casproxy::StreamReader reader(packetData);
 
     uint32_t packetId, resultCode, opcodeValue;
-    if (!reader.read(packetId) || !reader.read(resultCode) || !reader.read(opcodeValue)) {
+    if (!reader.readBe(packetId) || !reader.readBe(resultCode) || !reader.readBe(opcodeValue)) {
         return;
     }
 
-    packetId = casproxy::swapEndian32(packetId);
-    resultCode = casproxy::swapEndian32(resultCode);
-    opcodeValue = casproxy::swapEndian32(opcodeValue);
     casproxy::Opcode opcode = static_cast<casproxy::Opcode>(opcodeValue);
 
     auto res = casproxy::ResponseFactory::create(opcode);
@@ -131,89 +175,54 @@ void CasProxyClient::handleResponse() {
         return;
     }
 
-    std::lock_guard<std::mutex> lock(responsePromiseMutex);
-    auto it = mapResponsePromise.find(packetId);
-    if (it != mapResponsePromise.end()) {
-        it->second.set_value(std::move(res));
-    }
-}
-
-void CasProxyClient::onOpen() {
-    std::lock_guard<std::mutex> lock(connectionMutex);
-    connected = true;
-    connecting = false;
-
-    if (connectionPromise) {
-        connectionPromise->set_value(true);
-        connectionPromise = std::nullopt;
+    auto it = pendingRequests.find(packetId);
+    if (it != pendingRequests.end()) {
+        it->second->response = std::move(res);
+        it->second->signal.cancel();
+        pendingRequests.erase(it);
     }
 }
 
-void CasProxyClient::onFail() {
-    close();
-
-    std::lock_guard<std::mutex> lock(connectionMutex);
-    connected = false;
-    connecting = false;
-
-
-    if (connectionPromise) {
-        connectionPromise->set_value(false);
-        connectionPromise = std::nullopt;
+asio::awaitable<std::shared_ptr<casproxy::ResponseBase>> CasProxyClient::request(casproxy::RequestBase& req) {
+    if (!co_await ensureConnected()) {
+        throw std::runtime_error("Failed to connect to CasProxyServer");
     }
-}
 
-void CasProxyClient::onClose() {
-    connected = false;
-}
-
-std::optional<std::shared_ptr<casproxy::ResponseBase>> CasProxyClient::sendRequest(casproxy::RequestBase& req) {
-    if (connected == false) {
-        connectionPromise = std::promise<bool>();
-        connect();
-
-        auto future = connectionPromise->get_future();
-        if (!future.get()) {
-            throw std::runtime_error("Failed to connect to CasProxyServer");
-        }
-    }
-
-    std::lock_guard<std::mutex> lock(mutex);
     casproxy::StreamWriter writer;
-    req.packetId = packetId.fetch_add(1, std::memory_order_relaxed);
+    req.packetId = packetId++;
     req.pack(writer);
 
-    uint32_t packetLength = static_cast<uint32_t>(writer.buffer.size());
-    std::vector<uint8_t> packet(packetLength + 4);
-    packetLength = casproxy::swapEndian32(packetLength);
+    uint32_t packetLength = casproxy::swapEndian32(static_cast<uint32_t>(writer.buffer.size()));
+    std::vector<uint8_t> packet(writer.buffer.size() + 4);
     memcpy(packet.data(), &packetLength, 4);
     memcpy(packet.data() + 4, writer.buffer.data(), writer.buffer.size());
 
-    std::promise<std::shared_ptr<casproxy::ResponseBase>> promise;
-    auto future = promise.get_future();
+    auto pending = std::make_shared<PendingRequest>(io_context);
+    pending->signal.expires_after(std::chrono::milliseconds(kRequestTimeoutMs));
+    pendingRequests.emplace(req.packetId, pending);
 
-    {
-        std::lock_guard<std::mutex> lock(responsePromiseMutex);
-        mapResponsePromise.emplace(req.packetId, std::move(promise));
+    sendQueue.push_back(std::move(packet));
+    if (!writing) {
+        writing = true;
+        asio::co_spawn(io_context, doWrite(), asio::detached);
     }
 
-    sendQueue.push_back(packet);
-    if (sendQueue.size() < 2) {
-        doWrite();
-    }
-
-    if (future.wait_for(std::chrono::milliseconds(kRequestTimeoutMs)) == std::future_status::timeout) {
-        std::lock_guard<std::mutex> lock(responsePromiseMutex);
-        mapResponsePromise.erase(req.packetId);
+    asio::error_code ec;
+    co_await pending->signal.async_wait(asio::redirect_error(asio::use_awaitable, ec));
+    if (!ec) {
+        pendingRequests.erase(req.packetId);
         throw std::runtime_error("Timeout while requesting CasProxyServer");
     }
 
-    auto res = future.get();
-    {
-        std::lock_guard<std::mutex> lock(responsePromiseMutex);
-        mapResponsePromise.erase(req.packetId);
+    co_return pending->response;
+}
+
+std::optional<std::shared_ptr<casproxy::ResponseBase>> CasProxyClient::sendRequest(casproxy::RequestBase& req) {
+    if (closed) {
+        return std::nullopt;
     }
 
+    auto res = asio::co_spawn(io_context, request(req), asio::use_future).get();
     if (!res) {
         return std::nullopt;
     }
@@ -221,24 +230,6 @@ std::optional<std::shared_ptr<casproxy::ResponseBase>> CasProxyClient::sendReque
     return res;
 }
 
-void CasProxyClient::doWrite() {
-    if (sendQueue.empty()) {
-        return;
-    }
-
-    asio::async_write(socket, asio::buffer(sendQueue.front()),
-        [this](std::error_code ec, std::size_t) {
-            if (ec) {
-                close();
-            }
-            else {
-                sendQueue.pop_front();
-                doWrite();
-            }
-        }
-    );
-}
-
 LONG CasProxyClient::scardEstablishContext(DWORD dwScope, LPCVOID pvReserved1, LPCVOID pvReserved2, LPSCARDCONTEXT phContext) {
     casproxy::SCardEstablishContextRequest req;
     req.dwScope = dwScope;
@@ -536,3 +527,24 @@ LONG CasProxyClient::scardFreeMemory(SCARDCONTEXT hContext, LPCVOID pvMem) {
     delete[](char*)pvMem;
     return SCARD_S_SUCCESS;
 }
+
+LONG CasProxyClient::acasEcm(const std::string& reader, const std::vector<uint8_t>& ecm, uint16_t& sw, std::vector<uint8_t>& key) {
+    casproxy::AcasEcmRequest req;
+    req.szReader = reader;
+    req.ecm = ecm;
+
+    auto r = sendRequest(req);
+    if (!r) {
+        return SCARD_F_INTERNAL_ERROR;
+    }
+
+    auto res = std::dynamic_pointer_cast<casproxy::AcasEcmResponse>(*r);
+    if (res->resultCode != 0) {
+        throw std::runtime_error(std::string("CasProxyServer returned an error response"));
+    }
+
+    sw = static_cast<uint16_t>(res->sw);
+    key = std::move(res->key);
+
+    return res->apiReturn;
+}
@@ -1,4 +1,5 @@
 #pragma once
+#include <atomic>
 #include <thread>
 #include <optional>
 #include <memory>
@@ -8,11 +9,20 @@
 #include "casProxy.h"
 #include <deque>
 
+// Client of CasProxyServer. All network I/O runs as coroutines on the
+// client's own thread, so requests from any number of threads, e.g. every card
+// of a pool sharing one client, are pipelined on a single connection. The
+// SCard functions block their caller until the response arrives; coroutines
+// on getIoContext() can co_await request() instead.
 class CasProxyClient {
 public:
     CasProxyClient(const std::string& host, uint16_t port);
     ~CasProxyClient();
+    // Starts connecting in the background. Requests connect on demand.
     void connect();
+    // Connects if needed and waits for the connection. Returns false on failure.
+    bool waitConnected();
+    // Fails the outstanding requests and stops the client's thread.
     void close();
     LONG scardEstablishContext(DWORD dwScope, LPCVOID pvReserved1, LPCVOID pvReserved2, LPSCARDCONTEXT phContext);
     LONG scardReleaseContext(SCARDCONTEXT hContext);
@@ -24,39 +34,63 @@ public:
     LONG scardTransmit(SCARDHANDLE hCard, LPCSCARD_IO_REQUEST pioSendPci, LPCBYTE pbSendBuffer, DWORD cbSendLength, LPSCARD_IO_REQUEST pioRecvPci, LPBYTE pbRecvBuffer, LPDWORD pcbRecvLength);
     LONG scardGetAttrib(SCARDHANDLE hCard, DWORD dwAttrId, LPBYTE pbAttr, LPDWORD pcbAttrLen);
     LONG scardFreeMemory(SCARDCONTEXT hContext, LPCVOID pvMem);
+    // Resolves an ECM on the proxy in one round trip. key receives the odd key
+    // followed by the even key, sw the status word of the card.
+    LONG acasEcm(const std::string& reader, const std::vector<uint8_t>& ecm, uint16_t& sw, std::vector<uint8_t>& key);
+
+    // Sends a request on the client's thread and completes with its response,
+    // nullptr if the connection was lost. Any number of requests can be
+    // outstanding on the connection; responses are matched by packet id.
+    // Throws std::runtime_error if the server cannot be reached or does not
+    // answer in time. req must outlive the call.
+    asio::awaitable<std::shared_ptr<casproxy::ResponseBase>> request(casproxy::RequestBase& req);
+    asio::io_context& getIoContext() { return io_context; }
 
 private:
     static constexpr int kConnectionTimeoutMs = 5000;
     static constexpr int kRequestTimeoutMs = 5000;
+    static constexpr uint32_t kMaxPacketLength = 100 * 1024;
+
+    enum class State {
+        Disconnected,
+        Connecting,
+        Connected,
+    };
+
+    // A request waiting for its response. The timer expires on timeout and is
+    // cancelled when the response arrives or the connection is lost.
+    struct PendingRequest {
+        explicit PendingRequest(asio::io_context& io_context) : signal(io_context) {}
+        asio::steady_timer signal;
+        std::shared_ptr<casproxy::ResponseBase> response;
+    };
+
+    asio::awaitable<bool> ensureConnected();
+    asio::awaitable<void> doRead();
+    asio::awaitable<void> doWrite();
+    void handleResponse(const std::vector<uint8_t>& packetData);
+    void disconnect();
+    // Blocks the calling thread until the response arrives. Must not be
+    // called on the client's thread.
+    std::optional<std::shared_ptr<casproxy::ResponseBase>> sendRequest(casproxy::RequestBase& req);
 
-    void doWrite();
-    void doRead();
-    void readPacketData();
-    void handleResponse();
-    void onOpen();
-    void onFail();
-    void onClose();
-    std::optional<std::shared_ptr<casproxy::ResponseBase>> sendRequest(casproxy::RequestBase& res);
-
-    uint32_t packetLength;
-    std::vector<uint8_t> packetData;
-    std::string serverUrl;
-    asio::io_context io_context;
-    std::mutex mutex;
-    std::mutex responsePromiseMutex;
-    std::mutex connectionMutex;
-    std::thread thread;
-    std::map<uint32_t, std::promise<std::shared_ptr<casproxy::ResponseBase>>> mapResponsePromise;
-    std::optional<std::promise<bool>> connectionPromise;
-    bool connected{false};
-    bool connecting{false};
-    std::atomic<uint32_t> packetId;
     std::string host;
     uint16_t port;
+
+    // Everything below is only touched on the client's thread.
+    asio::io_context io_context;
+    asio::executor_work_guard<asio::io_context::executor_type> workGuard;
     asio::ip::tcp::resolver resolver;
     asio::ip::tcp::socket socket;
-    asio::steady_timer connectionTimer;
-    asio::executor_work_guard<asio::io_context::executor_type> workGuard;
+    // Cancelled when a connection attempt ends, to wake the requests waiting for it.
+    asio::steady_timer connectSignal;
+    State state{State::Disconnected};
+    uint32_t packetId{0};
+    std::map<uint32_t, std::shared_ptr<PendingRequest>> pendingRequests;
     std::deque<std::vector<uint8_t>> sendQueue;
+    bool writing{false};
+
+    std::atomic<bool> closed{false};
+    std::thread thread;
 
 };
\ No newline at end of file
@@ -0,0 +1,423 @@
+#include "casProxyServer.h"
+#include <csignal>
+#include <deque>
+#include <iostream>
+
+class CasProxyServer::Session : public std::enable_shared_from_this<Session> {
+public:
+    Session(CasProxyServer& server, asio::ip::tcp::socket socket)
+        : server(server), socket(std::move(socket)) {
+    }
+
+    void start() {
+        doRead();
+    }
+
+private:
+    void doRead() {
+        auto self = shared_from_this();
+        asio::async_read(socket, asio::buffer(&packetLength, 4),
+            [this, self](asio::error_code ec, std::size_t) {
+                if (ec) {
+                    return;
+                }
+
+                packetLength = casproxy::swapEndian32(packetLength);
+                if (packetLength > kMaxPacketLength) {
+                    return;
+                }
+
+                readPacketData();
+            }
+        );
+    }
+
+    void readPacketData() {
+        auto self = shared_from_this();
+        packetData.resize(packetLength);
+        asio::async_read(socket, asio::buffer(packetData),
+            [this, self](asio::error_code ec, std::size_t) {
+                if (ec) {
+                    return;
+                }
+
+                auto res = server.handleRequest(packetData);
+                if (!res) {
+                    // Unknown opcode, the client cannot match a response to it.
+                    asio::error_code ignored;
+                    socket.close(ignored);
+                    return;
+                }
+
+                send(*res);
+                doRead();
+            }
+        );
+    }
+
+    void send(const casproxy::ResponseBase& res) {
+        casproxy::StreamWriter writer;
+        res.pack(writer);
+
+        uint32_t length = casproxy::swapEndian32(static_cast<uint32_t>(writer.buffer.size()));
+        std::vector<uint8_t> packet(4 + writer.buffer.size());
+        memcpy(packet.data(), &length, 4);
+        memcpy(packet.data() + 4, writer.buffer.data(), writer.buffer.size());
+
+        if (server.delay.count() == 0) {
+            queue(std::move(packet));
+            return;
+        }
+
+        auto self = shared_from_this();
+        auto timer = std::make_shared<asio::steady_timer>(socket.get_executor(), server.delay);
+        timer->async_wait([this, self, timer, packet = std::move(packet)](asio::error_code ec) mutable {
+            if (!ec) {
+                queue(std::move(packet));
+            }
+        });
+    }
+
+    void queue(std::vector<uint8_t> packet) {
+        sendQueue.push_back(std::move(packet));
+        if (sendQueue.size() < 2) {
+            doWrite();
+        }
+    }
+
+    void doWrite() {
+        auto self = shared_from_this();
+        asio::async_write(socket, asio::buffer(sendQueue.front()),
+            [this, self](asio::error_code ec, std::size_t) {
+                if (ec) {
+                    asio::error_code ignored;
+                    socket.close(ignored);
+                    return;
+                }
+
+                sendQueue.pop_front();
+                if (!sendQueue.empty()) {
+                    doWrite();
+                }
+            }
+        );
+    }
+
+    CasProxyServer& server;
+    asio::ip::tcp::socket socket;
+    uint32_t packetLength{0};
+    std::vector<uint8_t> packetData;
+    std::deque<std::vector<uint8_t>> sendQueue;
+};
+
+CasProxyServer::CasProxyServer(uint16_t port, std::unique_ptr<ISmartCard> smartCard, std::chrono::microseconds delay)
+    : port(port), delay(delay), acceptor(io_context), smartCard(smartCard.get()) {
+    acasCard.setSmartCard(std::move(smartCard));
+}
+
+CasProxyServer::~CasProxyServer() {
+    stop();
+}
+
+void CasProxyServer::run() {
+    // Only local clients, the stand-in hands out keys to anyone who asks.
+    asio::ip::tcp::endpoint endpoint(asio::ip::address_v4::loopback(), port);
+    asio::error_code ec;
+    acceptor.open(endpoint.protocol(), ec);
+    if (!ec) {
+        acceptor.set_option(asio::ip::tcp::acceptor::reuse_address(true), ec);
+    }
+    if (!ec) {
+        acceptor.bind(endpoint, ec);
+    }
+    if (!ec) {
+        acceptor.listen(asio::socket_base::max_listen_connections, ec);
+    }
+    if (ec) {
+        throw std::runtime_error("Unable to listen on port " + std::to_string(port) + ": " + ec.message());
+    }
+
+    asio::signal_set signals(io_context, SIGINT, SIGTERM);
+    signals.async_wait([this](asio::error_code ec, int) {
+        if (!ec) {
+            stop();
+        }
+    });
+
+    doAccept();
+    io_context.run();
+}
+
+void CasProxyServer::stop() {
+    io_context.stop();
+}
+
+void CasProxyServer::doAccept() {
+    acceptor.async_accept(
+        [this](asio::error_code ec, asio::ip::tcp::socket socket) {
+            if (!ec) {
+                asio::error_code ignored;
+                socket.set_option(asio::ip::tcp::no_delay(true), ignored);
+                std::make_shared<Session>(*this, std::move(socket))->start();
+            }
+
+            if (acceptor.is_open()) {
+                doAccept();
+            }
+        }
+    );
+}
+
+std::shared_ptr<casproxy::ResponseBase> CasProxyServer::handleRequest(const std::vector<uint8_t>& packet) {
+    casproxy::StreamReader reader(packet);
+
+    uint32_t packetId, opcodeValue;
+    if (!reader.readBe(packetId) || !reader.readBe(opcodeValue)) {
+        return nullptr;
+    }
+
+    ++requestCount;
+
+    // Every response opcode follows the opcode of its request.
+    auto handle = [&](auto req, auto handler) -> std::shared_ptr<casproxy::ResponseBase> {
+        std::shared_ptr<casproxy::ResponseBase> res;
+        if (req.unpack(packetId, reader)) {
+            res = (this->*handler)(req);
+        }
+        else {
+            res = casproxy::ResponseFactory::create(static_cast<casproxy::Opcode>(opcodeValue + 1));
+            res->resultCode = 1;
+        }
+
+        res->packetId = packetId;
+        return res;
+    };
+
+    switch (static_cast<casproxy::Opcode>(opcodeValue)) {
+    case casproxy::Opcode::SCardEstablishContextReq:
+        return handle(casproxy::SCardEstablishContextRequest(), &CasProxyServer::establishContext);
+    case casproxy::Opcode::SCardReleaseContextReq:
+        return handle(casproxy::SCardReleaseContextRequest(), &CasProxyServer::releaseContext);
+    case casproxy::Opcode::SCardListReadersReq:
+        return handle(casproxy::SCardListReadersRequest(), &CasProxyServer::listReaders);
+    case casproxy::Opcode::SCardConnectReq:
+        return handle(casproxy::SCardConnectRequest(), &CasProxyServer::connect);
+    case casproxy::Opcode::SCardDisconnectReq:
+        return handle(casproxy::SCardDisconnectRequest(), &CasProxyServer::disconnect);
+    case casproxy::Opcode::SCardBeginTransactionReq:
+        return handle(casproxy::SCardBeginTransactionRequest(), &CasProxyServer::beginTransaction);
+    case casproxy::Opcode::SCardEndTransactionReq:
+        return handle(casproxy::SCardEndTransactionRequest(), &CasProxyServer::endTransaction);
+    case casproxy::Opcode::SCardTransmitReq:
+        return handle(casproxy::SCardTransmitRequest(), &CasProxyServer::transmit);
+    case casproxy::Opcode::SCardGetAttribReq:
+        return handle(casproxy::SCardGetAttribRequest(), &CasProxyServer::getAttrib);
+    case casproxy::Opcode::AcasEcmReq:
+        return handle(casproxy::AcasEcmRequest(), &CasProxyServer::acasEcm);
+    default:
+        return nullptr;
+    }
+}
+
+std::shared_ptr<casproxy::ResponseBase> CasProxyServer::establishContext(const casproxy::SCardEstablishContextRequest& req) {
+    auto res = std::make_shared<casproxy::SCardEstablishContextResponse>();
+    try {
+        if (!smartCard->isInited() && !smartCard->init()) {
+            res->apiReturn = SCARD_E_NO_SERVICE;
+            return res;
+        }
+    }
+    catch (const std::runtime_error&) {
+        res->apiReturn = SCARD_E_NO_SERVICE;
+        return res;
+    }
+
+    res->apiReturn = SCARD_S_SUCCESS;
+    res->hContext = kContext;
+    return res;
+}
+
+std::shared_ptr<casproxy::ResponseBase> CasProxyServer::releaseContext(const casproxy::SCardReleaseContextRequest& req) {
+    auto res = std::make_shared<casproxy::SCardReleaseContextResponse>();
+    res->apiReturn = req.hContext == kContext ? SCARD_S_SUCCESS : SCARD_E_INVALID_HANDLE;
+    return res;
+}
+
+std::shared_ptr<casproxy::ResponseBase> CasProxyServer::listReaders(const casproxy::SCardListReadersRequest& req) {
+    auto res = std::make_shared<casproxy::SCardListReadersResponse>();
+    if (req.hContext != kContext) {
+        res->apiReturn = SCARD_E_INVALID_HANDLE;
+        return res;
+    }
+
+    std::vector<std::string> readers;
+    try {
+        readers = smartCard->getReaders();
+    }
+    catch (const std::runtime_error&) {
+    }
+
+    if (readers.empty()) {
+        res->apiReturn = SCARD_E_NO_READERS_AVAILABLE;
+        return res;
+    }
+
+    // A multi-string: every name null-terminated, then an empty name.
+    std::vector<uint8_t> multiString;
+    for (const auto& reader : readers) {
+        multiString.insert(multiString.end(), reader.begin(), reader.end());
+        multiString.push_back(0);
+    }
+    multiString.push_back(0);
+
+    res->apiReturn = SCARD_S_SUCCESS;
+    res->readersLength = static_cast<uint32_t>(multiString.size());
+    if (req.readersLength > 0) {
+        res->readers = std::move(multiString);
+    }
+    return res;
+}
+
+std::shared_ptr<casproxy::ResponseBase> CasProxyServer::connect(const casproxy::SCardConnectRequest& req) {
+    auto res = std::make_shared<casproxy::SCardConnectResponse>();
+    if (req.hContext != kContext) {
+        res->apiReturn = SCARD_E_INVALID_HANDLE;
+        return res;
+    }
+
+    try {
+        smartCard->setSmartCardReaderName(req.szReader);
+        smartCard->connect();
+    }
+    catch (const std::runtime_error&) {
+        res->apiReturn = SCARD_E_NO_SMARTCARD;
+        return res;
+    }
+    acasCard.resetSession();
+
+    res->apiReturn = SCARD_S_SUCCESS;
+    res->hCard = kCard;
+    res->dwActiveProtocol = SCARD_PROTOCOL_T1;
+    return res;
+}
+
+std::shared_ptr<casproxy::ResponseBase> CasProxyServer::disconnect(const casproxy::SCardDisconnectRequest& req) {
+    auto res = std::make_shared<casproxy::SCardDisconnectResponse>();
+    if (req.hCard != kCard) {
+        res->apiReturn = SCARD_E_INVALID_HANDLE;
+        return res;
+    }
+
+    // The ACAS requests keep using the card, it stays connected.
+    transaction.reset();
+    res->apiReturn = SCARD_S_SUCCESS;
+    return res;
+}
+
+std::shared_ptr<casproxy::ResponseBase> CasProxyServer::beginTransaction(const casproxy::SCardBeginTransactionRequest& req) {
+    auto res = std::make_shared<casproxy::SCardBeginTransactionResponse>();
+    if (req.hCard != kCard || !smartCard->isConnected()) {
+        res->apiReturn = SCARD_E_INVALID_HANDLE;
+        return res;
+    }
+
+    try {
+        transaction = smartCard->scopedTransaction();
+    }
+    catch (const std::runtime_error&) {
+        res->apiReturn = SCARD_E_NOT_TRANSACTED;
+        return res;
+    }
+
+    res->apiReturn = SCARD_S_SUCCESS;
+    return res;
+}
+
+std::shared_ptr<casproxy::ResponseBase> CasProxyServer::endTransaction(const casproxy::SCardEndTransactionRequest& req) {
+    auto res = std::make_shared<casproxy::SCardEndTransactionResponse>();
+    if (req.hCard != kCard) {
+        res->apiReturn = SCARD_E_INVALID_HANDLE;
+        return res;
+    }
+
+    transaction.reset();
+    res->apiReturn = SCARD_S_SUCCESS;
+    return res;
+}
+
+std::shared_ptr<casproxy::ResponseBase> CasProxyServer::transmit(const casproxy::SCardTransmitRequest& req) {
+    auto res = std::make_shared<casproxy::SCardTransmitResponse>();
+    if (req.hCard != kCard || !smartCard->isConnected()) {
+        res->apiReturn = SCARD_E_INVALID_HANDLE;
+        return res;
+    }
+
+    ++apduCount;
+
+    // The client may authenticate the card itself, which replaces the session
+    // key of the ACAS requests.
+    acasCard.resetSession();
+
+    ApduResponse response;
+    uint32_t result;
+    try {
+        result = smartCard->transmit(req.sendBuffer, response);
+    }
+    catch (const std::runtime_error&) {
+        result = SCARD_F_INTERNAL_ERROR;
+    }
+
+    res->apiReturn = result;
+    if (result != SCARD_S_SUCCESS) {
+        return res;
+    }
+
+    const auto& data = response.getData();
+    if (data.size() + 2 > req.recvLength) {
+        res->apiReturn = SCARD_E_INSUFFICIENT_BUFFER;
+        return res;
+    }
+
+    res->recvBuffer.assign(data.begin(), data.end());
+    res->recvBuffer.push_back(response.getSw1());
+    res->recvBuffer.push_back(response.getSw2());
+    res->recvLength = static_cast<uint32_t>(res->recvBuffer.size());
+    return res;
+}
+
+std::shared_ptr<casproxy::ResponseBase> CasProxyServer::getAttrib(const casproxy::SCardGetAttribRequest& req) {
+    auto res = std::make_shared<casproxy::SCardGetAttribResponse>();
+    res->apiReturn = SCARD_E_UNSUPPORTED_FEATURE;
+    return res;
+}
+
+std::shared_ptr<casproxy::ResponseBase> CasProxyServer::acasEcm(const casproxy::AcasEcmRequest& req) {
+    auto res = std::make_shared<casproxy::AcasEcmResponse>();
+    ++ecmCount;
+
+    // A0 authentication and the ECM run here, next to the card.
+    if (!req.szReader.empty() && req.szReader != smartCard->getSmartCardReaderName()) {
+        smartCard->setSmartCardReaderName(req.szReader);
+        smartCard->disconnect();
+    }
+
+    AcasCard::DecryptionKey key;
+    if (!acasCard.ecm(req.ecm, key)) {
+        res->apiReturn = SCARD_S_SUCCESS;
+        res->sw = 0x6A00;
+        return res;
+    }
+
+    res->apiReturn = SCARD_S_SUCCESS;
+    res->sw = 0x9000;
+    res->key.assign(key.odd.begin(), key.odd.end());
+    res->key.insert(res->key.end(), key.even.begin(), key.even.end());
+    return res;
+}
+
+void CasProxyServer::printStatistics() const {
+    std::cerr << "CAS proxy stand-in:" << std::endl;
+    std::cerr << " - Requests: " << requestCount << std::endl;
+    std::cerr << " - ECMs: " << ecmCount << std::endl;
+    std::cerr << " - APDUs: " << apduCount << std::endl;
+}
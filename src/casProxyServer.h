@@ -0,0 +1,70 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include <asio.hpp>
+#include "acasCard.h"
+#include "casProxy.h"
+
+// A stand-in for CasProxyServer that serves a smart card of this process, e.g.
+// a ReplaySmartCard, on the loopback interface. It answers the SCard requests
+// with the APDUs of the card and the ACAS requests with AcasCard, so both ways
+// of resolving ECMs over the proxy can be run and timed without a card reader
+// or a remote proxy. Every response is held back by the given delay to stand
+// in for the round trip time of the network.
+//
+// Requests are handled one at a time on the thread that calls run().
+class CasProxyServer {
+public:
+    CasProxyServer(uint16_t port, std::unique_ptr<ISmartCard> smartCard, std::chrono::microseconds delay = {});
+    ~CasProxyServer();
+
+    CasProxyServer(const CasProxyServer&) = delete;
+    CasProxyServer& operator=(const CasProxyServer&) = delete;
+
+    // Serves connections until stop() is called or the process is interrupted.
+    // Throws std::runtime_error if the port cannot be bound.
+    void run();
+    void stop();
+
+    void printStatistics() const;
+
+private:
+    class Session;
+
+    void doAccept();
+    // Returns the response to a request packet, nullptr for unknown opcodes.
+    std::shared_ptr<casproxy::ResponseBase> handleRequest(const std::vector<uint8_t>& packet);
+
+    std::shared_ptr<casproxy::ResponseBase> establishContext(const casproxy::SCardEstablishContextRequest& req);
+    std::shared_ptr<casproxy::ResponseBase> releaseContext(const casproxy::SCardReleaseContextRequest& req);
+    std::shared_ptr<casproxy::ResponseBase> listReaders(const casproxy::SCardListReadersRequest& req);
+    std::shared_ptr<casproxy::ResponseBase> connect(const casproxy::SCardConnectRequest& req);
+    std::shared_ptr<casproxy::ResponseBase> disconnect(const casproxy::SCardDisconnectRequest& req);
+    std::shared_ptr<casproxy::ResponseBase> beginTransaction(const casproxy::SCardBeginTransactionRequest& req);
+    std::shared_ptr<casproxy::ResponseBase> endTransaction(const casproxy::SCardEndTransactionRequest& req);
+    std::shared_ptr<casproxy::ResponseBase> transmit(const casproxy::SCardTransmitRequest& req);
+    std::shared_ptr<casproxy::ResponseBase> getAttrib(const casproxy::SCardGetAttribRequest& req);
+    std::shared_ptr<casproxy::ResponseBase> acasEcm(const casproxy::AcasEcmRequest& req);
+
+    // The only context and card handle the stand-in hands out.
+    static constexpr uint64_t kContext = 1;
+    static constexpr uint64_t kCard = 1;
+    static constexpr uint32_t kMaxPacketLength = 100 * 1024;
+
+    uint16_t port;
+    std::chrono::microseconds delay;
+    asio::io_context io_context;
+    asio::ip::tcp::acceptor acceptor;
+
+    // Owned by acasCard, shared with the SCard requests.
+    ISmartCard* smartCard;
+    AcasCard acasCard;
+    std::unique_ptr<ISmartCard::Transaction> transaction;
+
+    std::atomic<uint64_t> requestCount{0};
+    std::atomic<uint64_t> ecmCount{0};
+    std::atomic<uint64_t> apduCount{0};
+};
@@ -1,35 +1,35 @@
 #include "compressedIPPacket.h"
-#include <vector>
 #include "stream.h"
 
 namespace MmtTlv {
 
 bool CompressedIPPacket::unpack(Common::ReadStream& stream)
 {
-	try {
-		uint16_t uint16 = stream.getBe16U();
-		contextId = (uint16 & 0b1111111111110000) >> 4;
-		sequenceNumber = uint16 & 0b0000000000001111;
-		headerType = static_cast<ContextHeaderType>(stream.get8U());
+	auto header = stream.getHeader(3);
+	if (!header) {
+		return false;
+	}
 
-		switch (headerType) {
-		case ContextHeaderType::ContextIdPartialIpv4AndPartialUdp:
-			break;
-		case ContextHeaderType::ContextIdIpv4Identifier:
-			break;
-		case ContextHeaderType::ContextIdPartialIpv6AndPartialUdp:
-			ipv6.assign(38, 0);
-			stream.read(ipv6.data(), 38);
+	uint16_t uint16 = header->getBe16U();
+	contextId = (uint16 & 0b1111111111110000) >> 4;
+	sequenceNumber = uint16 & 0b0000000000001111;
+	headerType = static_cast<ContextHeaderType>(header->get8U());
 
-			udp.assign(4, 0);
-			stream.read(udp.data(), 4);
-			break;
-		case ContextHeaderType::ContextIdNoCompressedHheader:
-			break;
+	switch (headerType) {
+	case ContextHeaderType::ContextIdPartialIpv4AndPartialUdp:
+		break;
+	case ContextHeaderType::ContextIdIpv4Identifier:
+		break;
+	case ContextHeaderType::ContextIdPartialIpv6AndPartialUdp:
+		if (stream.leftBytes() < 38 + 4) {
+			return false;
 		}
-	}
-	catch (const std::out_of_range&) {
-		return false;
+
+		ipv6 = stream.getSpan(38);
+		udp = stream.getSpan(4);
+		break;
+	case ContextHeaderType::ContextIdNoCompressedHheader:
+		break;
 	}
 
 	return true;
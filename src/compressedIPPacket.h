@@ -1,5 +1,5 @@
 #pragma once
-#include <vector>
+#include <span>
 #include "stream.h"
 
 namespace MmtTlv {
@@ -15,20 +15,22 @@ class CompressedIPPacket {
 public:
 	bool unpack(Common::ReadStream& stream);
 
-	std::vector<uint8_t> getCompressedHeader() const {
+	std::span<const uint8_t> getCompressedHeader() const {
 		return compressedHeader;
 	}
 
 public:
-	std::vector<uint8_t> compressedHeader;
+	// The header fields below are views into the buffer the packet was
+	// unpacked from.
+	std::span<const uint8_t> compressedHeader;
 	uint16_t contextId;
 	uint8_t sequenceNumber;
 	ContextHeaderType headerType;
 
 	// Not implemented
-	std::vector<uint8_t> ipv6;
-	std::vector<uint8_t> udp;
-	std::vector<uint8_t> ipv4;
+	std::span<const uint8_t> ipv6;
+	std::span<const uint8_t> udp;
+	std::span<const uint8_t> ipv4;
 };
 
 }
\ No newline at end of file
@@ -6,10 +6,26 @@
 #include "mmtTlvDemuxer.h"
 #include "aribUtil.h"
 #include "casProxyClient.h"
+#include "casProxyServer.h"
 #include "acasHandler.h"
 #include "smartCard.h"
+#include "replaySmartCard.h"
 #include "bufferedOutput.h"
+#include "uringIo.h"
+#include "fdIo.h"
 #include "progressReporter.h"
+#include "inputSource.h"
+#include "acasEcmWorker.h"
+#include "batch.h"
+#include "threadPool.h"
+#include "pipeline.h"
+#include "aesBenchmark.h"
+#include "parserBenchmark.h"
+#include "ecmPrefetcher.h"
+#include <atomic>
+#include <chrono>
+#include <iomanip>
+#include <mutex>
 
 namespace {
 
@@ -18,10 +34,28 @@ struct Args {
     std::string output;
     std::string casProxyHost;
     uint16_t casProxyPort{0};
-    std::string smartCardReaderName;
+    bool casProxyEcm{false};
+    uint16_t casProxyStandInPort{0};
+    uint32_t casProxyStandInDelay{0};
+    std::vector<std::string> smartCardReaderNames;
+    bool smartCardExclusive{false};
+    std::string smartCardCapture;
+    std::string smartCardReplay;
+    uint32_t smartCardLatency{0};
     std::string customWinscardDLL;
+    std::string ecmCache;
+    std::string batch;
+    std::string outputDir;
+    size_t jobs{0};
+    IoEngine ioEngine{IoEngine::Auto};
+    size_t pipeSize{0};
+    bool pipeline{false};
+    bool prefetchEcm{false};
+    size_t decryptThreads{0};
     bool disableADTSConversion{false};
     bool listSmartCardReader{false};
+    bool benchmarkAes{false};
+    bool benchmarkParser{false};
     bool noProgress{false};
     bool noStats{false};
 };
@@ -37,20 +71,38 @@ Args parseArguments(int argc, char* argv[]) {
             ("output", "Output file ('-' for stdout)", cxxopts::value<std::string>()->default_value(""))
             ("listSmartCardReader", "List available smart card readers", cxxopts::value<bool>()->default_value("false"))
             ("casProxyServer", "Specify the address of a CasProxyServer", cxxopts::value<std::string>())
-            ("smartCardReaderName", "Specify the smart card reader to use", cxxopts::value<std::string>())
+            ("casProxyEcm", "Let the CasProxyServer resolve whole ECMs, one round trip each (the server must support it)", cxxopts::value<bool>()->default_value("false"))
+            ("casProxyStandIn", "Serve the smart card as a local CasProxyServer on this port instead of converting", cxxopts::value<uint16_t>())
+            ("casProxyStandInDelay", "Delay every response of --casProxyStandIn by this many milliseconds", cxxopts::value<uint32_t>()->default_value("0"))
+            ("smartCardReaderName", "Specify the smart card reader to use, repeat to spread ECMs over several cards", cxxopts::value<std::vector<std::string>>())
+            ("smartCardExclusive", "Keep the smart card to this process and run A0 authentication once per session instead of before every ECM", cxxopts::value<bool>()->default_value("false"))
+            ("smartCardCapture", "Record the smart card traffic to this file", cxxopts::value<std::string>())
+            ("smartCardReplay", "Answer ECMs from a smart card capture instead of a smart card", cxxopts::value<std::string>())
+            ("smartCardLatency", "Add this many milliseconds to every command of --smartCardReplay", cxxopts::value<uint32_t>()->default_value("0"))
 #ifdef WIN32
             ("customWinscardDLL", "Specify the path to a winscard.dll", cxxopts::value<std::string>())
 #endif
+            ("ecmCache", "Store the keys of every ECM in this file and reuse them instead of asking the smart card", cxxopts::value<std::string>())
+            ("prefetchEcm", "Scan file input ahead of the demuxer and send its ECMs to the smart card early", cxxopts::value<bool>()->default_value("false"))
             ("disableADTSConversion", "Disable ADTS conversion", cxxopts::value<bool>()->default_value("false"))
+            ("ioEngine", "I/O engine (auto, mmap, stream, readahead, uring)", cxxopts::value<std::string>()->default_value("auto"))
+            ("pipeSize", "Enlarge stdin/stdout pipe buffers to this many bytes (Linux only)", cxxopts::value<size_t>()->default_value("0"))
+            ("pipeline", "Run input/decryption, demux/remux and output writes on separate threads", cxxopts::value<bool>()->default_value("false"))
+            ("decryptThreads", "Decrypt batches of packets on this many extra threads (implies --pipeline, 0: disabled)", cxxopts::value<size_t>()->default_value("0"))
+            ("batch", "Convert every .mmts file in a directory, or the input/output pairs listed in a file (one tab-separated pair per line)", cxxopts::value<std::string>())
+            ("outputDir", "Output directory for --batch with a directory", cxxopts::value<std::string>())
+            ("jobs", "Number of files converted in parallel with --batch (0: one per CPU core)", cxxopts::value<size_t>()->default_value("0"))
             ("no-progress", "Disable progress display", cxxopts::value<bool>()->default_value("false"))
             ("no-stats", "Disable packet statistics", cxxopts::value<bool>()->default_value("false"))
+            ("benchmarkAes", "Verify the AES-CTR kernels and print their throughput", cxxopts::value<bool>()->default_value("false"))
+            ("benchmarkParser", "Verify the packet header parsers and time them on intact and damaged packets", cxxopts::value<bool>()->default_value("false"))
             ("help", "Show help");
 
         options.parse_positional({ "input", "output" });
         options.positional_help("input output ('-' for stdin/stdout)");
         auto result = options.parse(argc, argv);
 
-        if (result.count("help") || (!result.count("listSmartCardReader") && (!result.count("input") || !result.count("output")))) {
+        if (result.count("help") || (!result.count("listSmartCardReader") && !result.count("casProxyStandIn") && !result.count("batch") && !result.count("benchmarkAes") && !result.count("benchmarkParser") && (!result.count("input") || !result.count("output")))) {
             std::cout << options.help() << std::endl;
             std::exit(1);
         }
@@ -71,8 +123,30 @@ Args parseArguments(int argc, char* argv[]) {
             }
         }
 
+        if (result["casProxyEcm"].count()) {
+            args.casProxyEcm = result["casProxyEcm"].as<bool>();
+        }
+        if (result["casProxyStandIn"].count()) {
+            args.casProxyStandInPort = result["casProxyStandIn"].as<uint16_t>();
+        }
+        if (result["casProxyStandInDelay"].count()) {
+            args.casProxyStandInDelay = result["casProxyStandInDelay"].as<uint32_t>();
+        }
+
         if (result["smartCardReaderName"].count()) {
-            args.smartCardReaderName = result["smartCardReaderName"].as<std::string>();
+            args.smartCardReaderNames = result["smartCardReaderName"].as<std::vector<std::string>>();
+        }
+        if (result["smartCardExclusive"].count()) {
+            args.smartCardExclusive = result["smartCardExclusive"].as<bool>();
+        }
+        if (result["smartCardCapture"].count()) {
+            args.smartCardCapture = result["smartCardCapture"].as<std::string>();
+        }
+        if (result["smartCardReplay"].count()) {
+            args.smartCardReplay = result["smartCardReplay"].as<std::string>();
+        }
+        if (result["smartCardLatency"].count()) {
+            args.smartCardLatency = result["smartCardLatency"].as<uint32_t>();
         }
         if (result["listSmartCardReader"].count()) {
             args.listSmartCardReader = result["listSmartCardReader"].as<bool>();
@@ -83,7 +157,42 @@ Args parseArguments(int argc, char* argv[]) {
         }
 #endif
 
-        if (!args.listSmartCardReader) {
+        if (result["ecmCache"].count()) {
+            args.ecmCache = result["ecmCache"].as<std::string>();
+        }
+
+        if (result["prefetchEcm"].count()) {
+            args.prefetchEcm = result["prefetchEcm"].as<bool>();
+        }
+
+        if (result["pipeline"].count()) {
+            args.pipeline = result["pipeline"].as<bool>();
+        }
+        if (result["decryptThreads"].count()) {
+            args.decryptThreads = result["decryptThreads"].as<size_t>();
+            if (args.decryptThreads > 0) {
+                args.pipeline = true;
+            }
+        }
+        if (result["batch"].count()) {
+            args.batch = result["batch"].as<std::string>();
+        }
+        if (result["outputDir"].count()) {
+            args.outputDir = result["outputDir"].as<std::string>();
+        }
+        if (result["jobs"].count()) {
+            args.jobs = result["jobs"].as<size_t>();
+        }
+
+        if (result["benchmarkAes"].count()) {
+            args.benchmarkAes = result["benchmarkAes"].as<bool>();
+        }
+
+        if (result["benchmarkParser"].count()) {
+            args.benchmarkParser = result["benchmarkParser"].as<bool>();
+        }
+
+        if (!args.listSmartCardReader && !args.benchmarkAes && !args.benchmarkParser && args.casProxyStandInPort == 0 && args.batch.empty()) {
             if (!result.count("input") || !result.count("output")) {
                 std::cerr << "input and output arguments are required" << std::endl;
                 std::exit(1);
@@ -98,6 +207,17 @@ Args parseArguments(int argc, char* argv[]) {
         if (result["disableADTSConversion"].count()) {
             args.disableADTSConversion = result["disableADTSConversion"].as<bool>();
         }
+        if (result["ioEngine"].count()) {
+            auto ioEngine = parseIoEngine(result["ioEngine"].as<std::string>());
+            if (!ioEngine) {
+                std::cerr << "Invalid ioEngine: " << result["ioEngine"].as<std::string>() << std::endl;
+                std::exit(1);
+            }
+            args.ioEngine = *ioEngine;
+        }
+        if (result["pipeSize"].count()) {
+            args.pipeSize = result["pipeSize"].as<size_t>();
+        }
         if (result["no-progress"].count()) {
             args.noProgress = result["no-progress"].as<bool>();
         }
@@ -141,139 +261,339 @@ void printReaderList(const Args& args) {
     }
 }
 
+// Returns the connection to the CasProxyServer, nullptr if cards are local.
+std::shared_ptr<CasProxyClient> createCasProxyClient(const Args& args) {
+    if (!args.smartCardReplay.empty() || args.casProxyHost.empty()) {
+        return nullptr;
+    }
+
+    auto client = std::make_shared<CasProxyClient>(args.casProxyHost, args.casProxyPort);
+    client->connect();
+    return client;
 }
 
-int main(int argc, char* argv[]) {
-    constexpr size_t chunkSize = 1024 * 1024 * 5; // 5MB
+// client is the connection to the CasProxyServer, shared by every card.
+std::unique_ptr<ISmartCard> createSmartCard(const Args& args, const std::string& readerName, const std::shared_ptr<CasProxyClient>& client) {
+    std::unique_ptr<ISmartCard> smartCard;
+    if (!args.smartCardReplay.empty()) {
+        smartCard = std::make_unique<ReplaySmartCard>(args.smartCardReplay, std::chrono::milliseconds(args.smartCardLatency));
+    }
+    else if (args.casProxyHost.empty()) {
+        auto localSmartCard = std::make_unique<LocalSmartCard>();
+        localSmartCard->setExclusive(args.smartCardExclusive);
+        smartCard = std::move(localSmartCard);
+    }
+    else {
+        auto remoteSmartCard = std::make_unique<RemoteSmartCard>(client);
+        remoteSmartCard->setProxyEcm(args.casProxyEcm);
+        remoteSmartCard->setExclusive(args.smartCardExclusive);
+        smartCard = std::move(remoteSmartCard);
+    }
 
-    Args args = parseArguments(argc, argv);
-#ifdef WIN32
-    config.customWinscardDLL = args.customWinscardDLL;
-#endif
-    config.disableADTSConversion = args.disableADTSConversion;
+    if (!args.smartCardCapture.empty()) {
+        smartCard = std::make_unique<CaptureSmartCard>(std::move(smartCard), args.smartCardCapture);
+    }
 
-    bool useStdin = (args.input == "-");
-    bool useStdout = (args.output == "-");
+    smartCard->setSmartCardReaderName(readerName);
+    return smartCard;
+}
 
-    if (args.listSmartCardReader) {
-        printReaderList(args);
-        return 0;
+std::shared_ptr<AcasEcmWorker> createEcmWorker(const Args& args) {
+    // Create the ECM worker with one smart card per reader, the default reader if none is given
+    auto ecmWorker = std::make_shared<AcasEcmWorker>();
+    ecmWorker->setPrintWarmUp(!args.noStats);
+    std::vector<std::string> readerNames = args.smartCardReaderNames;
+    if (readerNames.empty()) {
+        readerNames.emplace_back();
     }
 
-    std::istream* inputStream;
-    std::unique_ptr<std::ifstream> inputFs;
-    if (useStdin) {
-        inputStream = &std::cin;
+    // The cards of the pool pipeline their requests on one connection.
+    auto client = createCasProxyClient(args);
+
+    for (const auto& readerName : readerNames) {
+        ecmWorker->addSmartCard(createSmartCard(args, readerName, client));
     }
-    else {
-        inputFs = std::make_unique<std::ifstream>(args.input, std::ios::binary);
-        if (!inputFs->is_open()) {
-            std::cerr << "Unable to open input file: " << args.input << std::endl;
-            return 1;
-        }
-        inputStream = inputFs.get();
+    return ecmWorker;
+}
+
+// Serves the first smart card as a local CasProxyServer until interrupted.
+int runCasProxyStandIn(const Args& args) {
+    std::string readerName = args.smartCardReaderNames.empty() ? "" : args.smartCardReaderNames.front();
+
+    try {
+        CasProxyServer server(args.casProxyStandInPort, createSmartCard(args, readerName, createCasProxyClient(args)), std::chrono::milliseconds(args.casProxyStandInDelay));
+        std::cerr << "Serving the smart card on 127.0.0.1:" << args.casProxyStandInPort << std::endl;
+        server.run();
+        server.printStatistics();
+    }
+    catch (const std::runtime_error& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
+
+// Converts one input with its own demuxer and remuxer, sending ECMs to the
+// given worker. inputBytes receives the number of bytes demuxed.
+bool convertFile(const std::string& inputPath, const std::string& outputPath, const Args& args,
+    const std::shared_ptr<AcasEcmWorker>& ecmWorker, bool showProgress, bool showStats, uint64_t& inputBytes) {
+    constexpr size_t chunkSize = 1024 * 1024 * 5; // 5MB
+
+    std::unique_ptr<IInputSource> input = openInputSource(inputPath, args.ioEngine, chunkSize);
+    if (!input) {
+        std::cerr << "Unable to open input file: " << inputPath << std::endl;
+        return false;
     }
+    ProgressReporter progressReporter(input->getSize(), showProgress);
 
-    uint64_t fileSize = 0;
-    if (!useStdin) {
-        auto currentPos = inputFs->tellg();
-        inputFs->seekg(0, std::ios::end);
-        fileSize = inputFs->tellg();
-        inputFs->seekg(currentPos);
+    std::unique_ptr<EcmPrefetcher> ecmPrefetcher;
+    if (args.prefetchEcm) {
+        ecmPrefetcher = std::make_unique<EcmPrefetcher>(ecmWorker);
+        if (!ecmPrefetcher->start(inputPath)) {
+            ecmPrefetcher.reset();
+        }
     }
-    ProgressReporter progressReporter(fileSize, !args.noProgress);
 
-    std::ostream* outputStream;
     std::unique_ptr<std::ofstream> outputFs;
-    if (useStdout) {
-        outputStream = &std::cout;
+    std::unique_ptr<IOutput> output;
+    if (outputPath == "-") {
+        setBinaryMode(kStdoutFd);
+        output = std::make_unique<FdOutput>(kStdoutFd);
     }
     else {
-        outputFs = std::make_unique<std::ofstream>(args.output, std::ios::binary);
-        if (!outputFs->is_open()) {
-            std::cerr << "Unable to open output file: " << args.output << std::endl;
-            return 1;
+        if (args.ioEngine == IoEngine::Uring) {
+            output = openUringOutput(outputPath);
+            if (!output) {
+                std::cerr << "Unable to write the output file with io_uring, falling back to stream I/O: " << outputPath << std::endl;
+            }
+        }
+        if (!output) {
+            outputFs = std::make_unique<std::ofstream>(outputPath, std::ios::binary);
+            if (!outputFs->is_open()) {
+                std::cerr << "Unable to open output file: " << outputPath << std::endl;
+                return false;
+            }
+            output = std::make_unique<BufferedOutput>(*outputFs);
         }
-        outputStream = outputFs.get();
+    }
+
+    std::unique_ptr<PipelinedOutput> pipelinedOutput;
+    if (args.pipeline) {
+        pipelinedOutput = std::make_unique<PipelinedOutput>(*output);
     }
 
     MmtTlv::MmtTlvDemuxer demuxer;
     RemuxerHandler handler(demuxer);
-    std::unique_ptr<BufferedOutput> bufferedOutput;
 
-    if (useStdout) {
-        handler.setOutputCallback([&](const uint8_t* data, size_t size) {
-            assert(size == 188);
-            outputStream->write(reinterpret_cast<const char*>(data), size);
-        });
+    handler.setOutput(pipelinedOutput ? pipelinedOutput.get() : output.get());
+
+    demuxer.setDemuxerHandler(handler);
+    demuxer.setCasHandler(std::make_unique<AcasHandler>(ecmWorker));
+
+    if (args.pipeline) {
+        std::unique_ptr<ThreadPool> decryptionPool;
+        if (args.decryptThreads > 0) {
+            decryptionPool = std::make_unique<ThreadPool>(args.decryptThreads);
+        }
+
+        PipelinedDemuxer pipelinedDemuxer(demuxer, *input, progressReporter, decryptionPool.get());
+        if (ecmPrefetcher) {
+            pipelinedDemuxer.setPositionCallback([&](uint64_t position) {
+                ecmPrefetcher->setPosition(position);
+            });
+        }
+        inputBytes = pipelinedDemuxer.run();
+        pipelinedOutput->flush();
     }
     else {
-        bufferedOutput = std::make_unique<BufferedOutput>(*outputStream);
-        handler.setOutputCallback([&, bo = bufferedOutput.get()](const uint8_t* data, size_t size) {
-            assert(size == 188);
-            bo->write(data, size);
+        inputBytes = 0;
+        while (true) {
+            std::span<const uint8_t> inputData = input->next();
+
+            MmtTlv::Common::ReadStream stream(inputData);
+            while (!stream.isEof()) {
+                MmtTlv::DemuxStatus status = demuxer.demux(stream);
+
+                if (status == MmtTlv::DemuxStatus::NotEnoughBuffer) {
+                    break;
+                }
+            }
+
+            auto consumed = inputData.size() - stream.leftBytes();
+            if (consumed > 0) {
+                progressReporter.update(consumed);
+                inputBytes += consumed;
+                if (ecmPrefetcher) {
+                    ecmPrefetcher->setPosition(inputBytes);
+                }
+            }
+            input->consume(consumed);
+
+            if (consumed == 0 && input->isEof()) {
+                break;
+            }
+        }
+        demuxer.flushHeldPackets();
+    }
+
+    progressReporter.finish();
+    if (ecmPrefetcher) {
+        ecmPrefetcher->stop();
+    }
+    if (showStats) {
+        demuxer.printStatistics();
+        input->printStatistics();
+        if (ecmPrefetcher) {
+            ecmPrefetcher->printStatistics();
+        }
+    }
+    demuxer.clear();
+
+    output->flush();
+    if (output->hasFailed()) {
+        std::cerr << "Unable to write output file: " << outputPath << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+// Converts every job of the batch on a thread pool. All files share the ECM
+// worker, so the smart card session is set up once for the whole batch.
+int runBatch(const Args& args, const std::shared_ptr<AcasEcmWorker>& ecmWorker) {
+    auto jobs = loadBatchJobs(args.batch, args.outputDir);
+    if (!jobs) {
+        return 1;
+    }
+    if (jobs->empty()) {
+        std::cerr << "No input files to convert" << std::endl;
+        return 1;
+    }
+
+    auto toSeconds = [](std::chrono::steady_clock::duration d) {
+        return std::chrono::duration<double>(d).count();
+    };
+    constexpr double mebibyte = 1024.0 * 1024.0;
+
+    std::mutex logMutex;
+    std::atomic<uint64_t> totalBytes{0};
+    std::atomic<size_t> failedCount{0};
+    auto start = std::chrono::steady_clock::now();
+
+    ThreadPool pool(args.jobs);
+    for (const auto& job : *jobs) {
+        pool.submit([&, job]() {
+            auto fileStart = std::chrono::steady_clock::now();
+            uint64_t inputBytes = 0;
+            bool ok = false;
+            try {
+                ok = convertFile(job.input, job.output, args, ecmWorker, false, false, inputBytes);
+            }
+            catch (const std::exception& e) {
+                std::lock_guard<std::mutex> lock(logMutex);
+                std::cerr << job.input << ": " << e.what() << std::endl;
+            }
+            double seconds = toSeconds(std::chrono::steady_clock::now() - fileStart);
+            totalBytes += inputBytes;
+
+            std::lock_guard<std::mutex> lock(logMutex);
+            if (ok) {
+                std::cerr << "Converted " << job.input << " (" << std::fixed << std::setprecision(1)
+                    << (seconds > 0 ? inputBytes / mebibyte / seconds : 0.0) << " MiB/s)" << std::endl;
+            }
+            else {
+                ++failedCount;
+                std::cerr << "Failed to convert " << job.input << std::endl;
+            }
         });
     }
+    pool.wait();
+
+    double seconds = toSeconds(std::chrono::steady_clock::now() - start);
+    double totalMebibytes = totalBytes.load() / mebibyte;
+    std::cerr << "Batch:" << std::endl;
+    std::cerr << " - Files: " << jobs->size() << std::endl;
+    std::cerr << " - Failed: " << failedCount.load() << std::endl;
+    std::cerr << " - Threads: " << pool.size() << std::endl;
+    std::cerr << " - Input: " << std::fixed << std::setprecision(1) << totalMebibytes << " MiB" << std::endl;
+    std::cerr << " - Elapsed: " << std::fixed << std::setprecision(3) << seconds << "s" << std::endl;
+    std::cerr << " - Throughput: " << std::fixed << std::setprecision(1) << (seconds > 0 ? totalMebibytes / seconds : 0.0) << " MiB/s" << std::endl;
+
+    return failedCount.load() == 0 ? 0 : 1;
+}
 
-    demuxer.setDemuxerHandler(handler);
+}
 
-    try {
-        // Create ACAS handler and initialize the smart card
-        std::unique_ptr<AcasHandler> acasHandler = std::make_unique<AcasHandler>();
-        std::unique_ptr<ISmartCard> smartCard;
-        if (args.casProxyHost.empty()) {
-            smartCard = std::make_unique<LocalSmartCard>();
+int main(int argc, char* argv[]) {
+    Args args = parseArguments(argc, argv);
+#ifdef WIN32
+    config.customWinscardDLL = args.customWinscardDLL;
+#endif
+    config.disableADTSConversion = args.disableADTSConversion;
+
+    bool useStdout = (args.output == "-");
+
+    if (args.listSmartCardReader) {
+        printReaderList(args);
+        return 0;
+    }
+
+    if (args.benchmarkAes) {
+        return runAesBenchmark() ? 0 : 1;
+    }
+
+    if (args.benchmarkParser) {
+        return runParserBenchmark() ? 0 : 1;
+    }
+
+    if (args.casProxyStandInPort != 0) {
+        return runCasProxyStandIn(args);
+    }
+
+    if (args.ioEngine == IoEngine::Uring && !isUringAvailable()) {
+        std::cerr << "io_uring is not available, falling back to stream I/O" << std::endl;
+        args.ioEngine = IoEngine::Stream;
+    }
+
+    if (args.pipeSize > 0) {
+        if (args.input == "-" && !setPipeSize(kStdinFd, args.pipeSize)) {
+            std::cerr << "Unable to set the stdin pipe size to " << args.pipeSize << std::endl;
         }
-        else {
-            smartCard = std::make_unique<RemoteSmartCard>(args.casProxyHost, args.casProxyPort);
+        if (useStdout && !setPipeSize(kStdoutFd, args.pipeSize)) {
+            std::cerr << "Unable to set the stdout pipe size to " << args.pipeSize << std::endl;
         }
-        
-        smartCard->setSmartCardReaderName(args.smartCardReaderName);
-        acasHandler->setSmartCard(std::move(smartCard));
-        demuxer.setCasHandler(std::move(acasHandler));
+    }
+
+    std::shared_ptr<AcasEcmWorker> ecmWorker;
+    try {
+        ecmWorker = createEcmWorker(args);
     }
     catch (const std::runtime_error& e) {
         std::cerr << e.what() << std::endl;
         return 1;
     }
 
-    std::vector<uint8_t> inputBuffer;
-    inputBuffer.reserve(chunkSize * 2);
-    while (true) {
-        if (!useStdin && inputStream->eof()) {
-            break;
-        }
-
-        size_t oldSize = inputBuffer.size();
-        size_t bytesToRead = chunkSize;
-        if (oldSize < chunkSize) {
-            inputBuffer.resize(oldSize + bytesToRead);
-            inputStream->read(reinterpret_cast<char*>(inputBuffer.data() + oldSize), chunkSize);
-            std::streamsize bytesRead = inputStream->gcount();
-            inputBuffer.resize(oldSize + bytesRead);
-        }
-
-        MmtTlv::Common::ReadStream stream(inputBuffer);
-        while (!stream.isEof()) {
-            MmtTlv::DemuxStatus status = demuxer.demux(stream);
+    if (!args.ecmCache.empty() && !ecmWorker->getEcmKeyCache()->open(args.ecmCache)) {
+        std::cerr << "Unable to open the ECM key cache: " << args.ecmCache << std::endl;
+        return 1;
+    }
 
-            if (status == MmtTlv::DemuxStatus::NotEnoughBuffer) {
-                break;
-            }
+    if (!args.batch.empty()) {
+        int result = runBatch(args, ecmWorker);
+        if (!args.noStats) {
+            ecmWorker->printStatistics();
         }
-        
-        auto consumed = inputBuffer.size() - stream.leftBytes();
-        if (consumed > 0) {
-            progressReporter.update(consumed);
-        }
-        inputBuffer.erase(inputBuffer.begin(), inputBuffer.begin() + consumed);
+        return result;
     }
 
-    progressReporter.finish();
+    uint64_t inputBytes = 0;
+    if (!convertFile(args.input, args.output, args, ecmWorker, !args.noProgress, !args.noStats, inputBytes)) {
+        return 1;
+    }
     if (!args.noStats) {
-        demuxer.printStatistics();
+        ecmWorker->printStatistics();
     }
-    demuxer.clear();
 
     return 0;
 }
@@ -3,53 +3,72 @@
 namespace MmtTlv {
 
 bool DataUnit::unpack(Common::ReadStream& stream, bool timedFlag, bool aggregateFlag) {
-	try {
-		if (timedFlag) {
-			if (aggregateFlag == 0) {
-				movieFragmentSequenceNumber = stream.getBe32U();
-				sampleNumber = stream.getBe32U();
-				offset = stream.getBe32U();
-				priority = stream.get8U();
-				dependencyCounter = stream.get8U();
-
-				data.resize(stream.leftBytes());
-				stream.read(data.data(), stream.leftBytes());
-			}
-			else {
-				dataUnitLength = stream.getBe16U();
-				dataUnitLength = std::min(dataUnitLength, static_cast<uint16_t>(stream.leftBytes()));
-
-				movieFragmentSequenceNumber = stream.getBe32U();
-				sampleNumber = stream.getBe32U();
-				offset = stream.getBe32U();
-				priority = stream.get8U();
-				dependencyCounter = stream.get8U();
-
-				if (dataUnitLength < 4 * 3 + 2) {
-					return false;
-				}
-
-				data.resize(dataUnitLength - 4 * 3 - 2);
-				stream.read(data.data(), dataUnitLength - 4 * 3 - 2);
+	if (timedFlag) {
+		if (aggregateFlag == 0) {
+			auto header = stream.getHeader(4 * 3 + 2);
+			if (!header) {
+				return false;
 			}
+
+			movieFragmentSequenceNumber = header->getBe32U();
+			sampleNumber = header->getBe32U();
+			offset = header->getBe32U();
+			priority = header->get8U();
+			dependencyCounter = header->get8U();
+
+			data = stream.getSpan(stream.leftBytes());
 		}
 		else {
-			if (aggregateFlag == 0) {
-				itemId = stream.getBe32U();
+			auto length = stream.getHeader(2);
+			if (!length) {
+				return false;
+			}
+
+			dataUnitLength = length->getBe16U();
+			dataUnitLength = std::min(dataUnitLength, static_cast<uint16_t>(stream.leftBytes()));
 
-				data.resize(stream.leftBytes());
-				stream.read(data.data(), stream.leftBytes());
+			auto header = stream.getHeader(4 * 3 + 2);
+			if (!header) {
+				return false;
 			}
-			else {
-				dataUnitLength = stream.getBe16U();
 
-				data.resize(dataUnitLength);
-				stream.read(data.data(), dataUnitLength);
+			movieFragmentSequenceNumber = header->getBe32U();
+			sampleNumber = header->getBe32U();
+			offset = header->getBe32U();
+			priority = header->get8U();
+			dependencyCounter = header->get8U();
+
+			if (dataUnitLength < 4 * 3 + 2) {
+				return false;
 			}
+
+			data = stream.getSpan(dataUnitLength - 4 * 3 - 2);
 		}
 	}
-	catch (const std::out_of_range&) {
-		return false;
+	else {
+		if (aggregateFlag == 0) {
+			auto header = stream.getHeader(4);
+			if (!header) {
+				return false;
+			}
+
+			itemId = header->getBe32U();
+
+			data = stream.getSpan(stream.leftBytes());
+		}
+		else {
+			auto length = stream.getHeader(2);
+			if (!length) {
+				return false;
+			}
+
+			dataUnitLength = length->getBe16U();
+			if (stream.leftBytes() < dataUnitLength) {
+				return false;
+			}
+
+			data = stream.getSpan(dataUnitLength);
+		}
 	}
 
 	return true;
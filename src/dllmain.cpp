@@ -57,10 +57,7 @@ extern "C" __declspec(dllexport) IBonDriver* CreateBonDriver() {
         return nullptr;
     }
 
-    g_bonDriverContext.handler.setOutputCallback([&](const uint8_t* data, size_t size) {
-        assert(size == 188);
-        g_bonDriverContext.remuxOutput.insert(g_bonDriverContext.remuxOutput.end(), data, data + size);
-    });
+    g_bonDriverContext.handler.setOutput(&g_bonDriverContext.remuxSink);
     g_bonDriverContext.demuxer.setDemuxerHandler(g_bonDriverContext.handler);
     g_bonDriverContext.bonTuner.init();
 
@@ -0,0 +1,303 @@
+#include "ecmKeyCache.h"
+#include <cstring>
+#include <iostream>
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+bool isZero(const std::array<uint8_t, 16>& key) {
+    for (uint8_t byte : key) {
+        if (byte != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+}
+
+size_t EcmKeyCache::HashPrefix::operator()(const RecordKey& key) const {
+    size_t value;
+    memcpy(&value, key.data(), sizeof(value));
+    return value;
+}
+
+EcmKeyCache::RecordKey EcmKeyCache::toRecordKey(const sha256_t& ecmHash) {
+    RecordKey key;
+    memcpy(key.data(), ecmHash.data(), key.size());
+    return key;
+}
+
+uint32_t EcmKeyCache::getChecksum(const Record& record) {
+    uint32_t hash = 0x811c9dc5;
+    auto update = [&](const uint8_t* data, size_t size) {
+        for (size_t i = 0; i < size; ++i) {
+            hash = (hash ^ data[i]) * 0x01000193;
+        }
+    };
+    update(record.ecmHash.data(), record.ecmHash.size());
+    update(record.odd.data(), record.odd.size());
+    update(record.even.data(), record.even.size());
+    return hash;
+}
+
+EcmKeyCache::~EcmKeyCache() {
+    close();
+}
+
+sha256_t EcmKeyCache::hashEcm(const std::vector<uint8_t>& ecm) {
+    return SHA256::hash(ecm);
+}
+
+bool EcmKeyCache::open(const std::string& path) {
+    close();
+
+    // Create the file with its header unless it exists already.
+    std::FILE* created = std::fopen(path.c_str(), "wbx");
+    if (created) {
+        uint8_t header[kHeaderSize] = {};
+        memcpy(header, kMagic, sizeof(kMagic));
+        uint32_t version = kVersion;
+        uint32_t recordSize = sizeof(Record);
+        memcpy(header + 8, &version, 4);
+        memcpy(header + 12, &recordSize, 4);
+        bool written = std::fwrite(header, 1, sizeof(header), created) == sizeof(header);
+        std::fclose(created);
+        if (!written) {
+            return false;
+        }
+    }
+
+    if (!map(path)) {
+        return false;
+    }
+
+    if (size < kHeaderSize || memcmp(data, kMagic, sizeof(kMagic)) != 0) {
+        unmap();
+        return false;
+    }
+    uint32_t version;
+    uint32_t recordSize;
+    memcpy(&version, data + 8, 4);
+    memcpy(&recordSize, data + 12, 4);
+    if (version != kVersion || recordSize != sizeof(Record)) {
+        unmap();
+        return false;
+    }
+
+    size_t count = static_cast<size_t>((size - kHeaderSize) / sizeof(Record));
+    const Record* records = reinterpret_cast<const Record*>(data + kHeaderSize);
+    mappedRecords.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        uint32_t checksum = getChecksum(records[i]);
+        if (memcmp(records[i].checksum, &checksum, sizeof(checksum)) != 0) {
+            ++invalidRecords;
+            continue;
+        }
+        mappedRecords[records[i].ecmHash] = &records[i];
+    }
+
+    file = std::fopen(path.c_str(), "ab");
+    if (!file) {
+        close();
+        return false;
+    }
+    // Every record goes out in a single write.
+    std::setvbuf(file, nullptr, _IONBF, 0);
+
+    // Complete a record cut short by a crash, so that new records are aligned.
+    size_t tail = static_cast<size_t>((size - kHeaderSize) % sizeof(Record));
+    if (tail != 0) {
+        uint8_t padding[sizeof(Record)] = {};
+        if (std::fwrite(padding, 1, sizeof(Record) - tail, file) != sizeof(Record) - tail) {
+            close();
+            return false;
+        }
+        ++invalidRecords;
+    }
+    return true;
+}
+
+void EcmKeyCache::close() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (file) {
+        std::fclose(file);
+        file = nullptr;
+    }
+    addedRecords.clear();
+    mappedRecords.clear();
+    invalidRecords = 0;
+    unmap();
+}
+
+bool EcmKeyCache::map(const std::string& path) {
+#ifdef _WIN32
+    HANDLE hFile = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr,
+        OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (hFile == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(hFile, &fileSize) || static_cast<uint64_t>(fileSize.QuadPart) > SIZE_MAX) {
+        CloseHandle(hFile);
+        return false;
+    }
+    if (fileSize.QuadPart == 0) {
+        CloseHandle(hFile);
+        return true;
+    }
+
+    HANDLE hMapping = CreateFileMappingA(hFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    CloseHandle(hFile);
+    if (hMapping == nullptr) {
+        return false;
+    }
+
+    // The view keeps its own reference to the mapping object.
+    void* view = MapViewOfFile(hMapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(hMapping);
+    if (view == nullptr) {
+        return false;
+    }
+
+    size = static_cast<uint64_t>(fileSize.QuadPart);
+#else
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || static_cast<uint64_t>(st.st_size) > SIZE_MAX) {
+        ::close(fd);
+        return false;
+    }
+    if (st.st_size == 0) {
+        ::close(fd);
+        return true;
+    }
+
+    // The mapping stays valid after the descriptor is closed.
+    void* view = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (view == MAP_FAILED) {
+        return false;
+    }
+
+    size = static_cast<uint64_t>(st.st_size);
+#endif
+
+    data = static_cast<const uint8_t*>(view);
+    return true;
+}
+
+void EcmKeyCache::unmap() {
+    if (data == nullptr) {
+        return;
+    }
+
+#ifdef _WIN32
+    UnmapViewOfFile(data);
+#else
+    munmap(const_cast<uint8_t*>(data), static_cast<size_t>(size));
+#endif
+    data = nullptr;
+    size = 0;
+}
+
+std::optional<AcasCard::DecryptionKey> EcmKeyCache::find(const sha256_t& ecmHash) {
+    auto key = peek(ecmHash);
+    if (key) {
+        ++hits;
+    }
+    else {
+        ++misses;
+    }
+    return key;
+}
+
+std::optional<AcasCard::DecryptionKey> EcmKeyCache::peek(const sha256_t& ecmHash) {
+    RecordKey key = toRecordKey(ecmHash);
+
+    // The mapped records never change, so they are looked up without locking.
+    auto mapped = mappedRecords.find(key);
+    if (mapped != mappedRecords.end()) {
+        return AcasCard::DecryptionKey{ mapped->second->odd, mapped->second->even };
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    auto added = addedRecords.find(key);
+    if (added != addedRecords.end()) {
+        return added->second.key;
+    }
+    return std::nullopt;
+}
+
+void EcmKeyCache::insert(const sha256_t& ecmHash, const AcasCard::DecryptionKey& key) {
+    // The card returns zero keys for ECMs it rejected, which must be retried next time.
+    if (isZero(key.odd) && isZero(key.even)) {
+        return;
+    }
+    RecordKey recordKey = toRecordKey(ecmHash);
+    if (mappedRecords.find(recordKey) != mappedRecords.end()) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (addedRecords.emplace(recordKey, AddedRecord{ key }).second) {
+        ++added;
+    }
+}
+
+void EcmKeyCache::confirm(const sha256_t& ecmHash) {
+    RecordKey recordKey = toRecordKey(ecmHash);
+    if (mappedRecords.find(recordKey) != mappedRecords.end()) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    auto added = addedRecords.find(recordKey);
+    if (added == addedRecords.end() || added->second.written) {
+        return;
+    }
+    added->second.written = true;
+    ++stored;
+
+    if (file) {
+        const AcasCard::DecryptionKey& key = added->second.key;
+        Record record{ recordKey, {}, key.odd, key.even };
+        uint32_t checksum = getChecksum(record);
+        memcpy(record.checksum, &checksum, sizeof(checksum));
+        if (std::fwrite(&record, sizeof(record), 1, file) != 1) {
+            std::cerr << "Unable to write to the ECM key cache" << std::endl;
+            std::fclose(file);
+            file = nullptr;
+        }
+    }
+}
+
+void EcmKeyCache::printStatistics() const {
+    std::cerr << "ECM key cache:" << std::endl;
+    std::cerr << " - Records: " << mappedRecords.size() + stored.load() << std::endl;
+    if (added.load() > stored.load()) {
+        // Keys that never decrypted a packet, they were not written.
+        std::cerr << " - Unconfirmed: " << added.load() - stored.load() << std::endl;
+    }
+    if (invalidRecords > 0) {
+        std::cerr << " - Invalid records: " << invalidRecords << std::endl;
+    }
+    std::cerr << " - Hits: " << hits.load() << std::endl;
+    std::cerr << " - Misses: " << misses.load() << std::endl;
+    std::cerr << " - Stored: " << stored.load() << std::endl;
+}
@@ -0,0 +1,99 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "acasCard.h"
+#include "sha256.h"
+
+// Cache of the keys the smart card returned for each ECM. Once opened, it is
+// persistent, so that converting the same recording again needs no card at
+// all. Without open() it only lives in memory.
+//
+// The file is a header followed by fixed-size records of the SHA-256 of the
+// ECM, truncated to 224 bits, a checksum and its odd and even keys. Records
+// are only ever appended, one write per record, so several processes can share
+// the file. The records present when the cache is opened are memory-mapped and
+// looked up through an index of their offsets; records added afterwards are
+// kept in memory as well. A record left incomplete by a crash fails its
+// checksum and is padded so that the following records stay aligned.
+//
+// A key the card returned is only written once it has been seen to decrypt a
+// packet, so that a wrong key, e.g. one unmasked with a stale session key, is
+// not served again by later runs.
+class EcmKeyCache {
+public:
+    EcmKeyCache() = default;
+    ~EcmKeyCache();
+
+    EcmKeyCache(const EcmKeyCache&) = delete;
+    EcmKeyCache& operator=(const EcmKeyCache&) = delete;
+
+    // Opens or creates the cache file. Returns false if the file cannot be
+    // created or is not a cache file.
+    bool open(const std::string& path);
+    void close();
+
+    // Thread-safe.
+    std::optional<AcasCard::DecryptionKey> find(const sha256_t& ecmHash);
+    // The same as find(), without counting a hit or miss.
+    std::optional<AcasCard::DecryptionKey> peek(const sha256_t& ecmHash);
+    // Adds the key in memory. It is written to the file by confirm().
+    void insert(const sha256_t& ecmHash, const AcasCard::DecryptionKey& key);
+    // Writes the key of the ECM to the file, once its key has decrypted a packet.
+    void confirm(const sha256_t& ecmHash);
+
+    void printStatistics() const;
+
+    static sha256_t hashEcm(const std::vector<uint8_t>& ecm);
+
+private:
+    using RecordKey = std::array<uint8_t, 28>;
+
+    struct Record {
+        RecordKey ecmHash;
+        // FNV-1a of the other fields, little endian.
+        uint8_t checksum[4];
+        std::array<uint8_t, 16> odd;
+        std::array<uint8_t, 16> even;
+    };
+    static_assert(sizeof(Record) == 64);
+
+    struct HashPrefix {
+        size_t operator()(const RecordKey& key) const;
+    };
+
+    struct AddedRecord {
+        AcasCard::DecryptionKey key;
+        bool written{false};
+    };
+
+    static RecordKey toRecordKey(const sha256_t& ecmHash);
+    static uint32_t getChecksum(const Record& record);
+
+    static constexpr char kMagic[8] = { 'D', 'T', '4', 'K', 'E', 'C', 'M', 'C' };
+    static constexpr uint32_t kVersion = 1;
+    static constexpr size_t kHeaderSize = 16;
+
+    bool map(const std::string& path);
+    void unmap();
+
+    // Read-only view of the file as it was when opened, and the index of its records.
+    const uint8_t* data{nullptr};
+    uint64_t size{0};
+    std::unordered_map<RecordKey, const Record*, HashPrefix> mappedRecords;
+
+    std::mutex mutex;
+    std::FILE* file{nullptr};
+    std::unordered_map<RecordKey, AddedRecord, HashPrefix> addedRecords;
+
+    std::atomic<uint64_t> hits{0};
+    std::atomic<uint64_t> misses{0};
+    std::atomic<uint64_t> added{0};
+    std::atomic<uint64_t> stored{0};
+    size_t invalidRecords{0};
+};
@@ -0,0 +1,214 @@
+#include "ecmPrefetcher.h"
+#include <filesystem>
+#include <iostream>
+#include "acasEcmWorker.h"
+#include "caMessage.h"
+#include "compressedIPPacket.h"
+#include "ecm.h"
+#include "inputSource.h"
+#include "mmtp.h"
+#include "mmtTlvDemuxer.h"
+#include "signalingMessage.h"
+#include "stream.h"
+
+namespace {
+
+constexpr size_t kTlvHeaderSize = 4;
+
+// Same checks as MmtTlvDemuxer::isValidTlv.
+bool isValidTlv(std::span<const uint8_t> data) {
+    return data[0] == 0x7F && (data[1] <= 0x04 || data[1] >= 0xFD);
+}
+
+// Extracts the ECM carried by a TLV packet, if any. Only control packets are
+// parsed beyond their headers; ECMs are short enough never to be fragmented
+// or aggregated.
+bool parseEcm(std::span<const uint8_t> packet, std::vector<uint8_t>& ecm) {
+    if (packet[1] != static_cast<uint8_t>(MmtTlv::TlvPacketType::HeaderCompressedIpPacket)) {
+        return false;
+    }
+
+    MmtTlv::Common::ReadStream stream(packet.subspan(kTlvHeaderSize));
+    MmtTlv::CompressedIPPacket compressedIPPacket;
+    if (!compressedIPPacket.unpack(stream)) {
+        return false;
+    }
+
+    // Skip other payloads before the MMTP packet is copied.
+    if (stream.leftBytes() < 2 ||
+        (packet[kTlvHeaderSize + stream.getPos() + 1] & 0b00111111) != static_cast<uint8_t>(MmtTlv::PayloadType::ContainsOneOrMoreControlMessage)) {
+        return false;
+    }
+
+    MmtTlv::Mmtp mmtp;
+    if (!mmtp.unpack(stream)) {
+        return false;
+    }
+
+    MmtTlv::Common::ReadStream mmtpPayloadStream(mmtp.payload);
+    MmtTlv::SignalingMessage signalingMessage;
+    if (!signalingMessage.unpack(mmtpPayloadStream) || signalingMessage.aggregationFlag ||
+        signalingMessage.fragmentationIndicator != MmtTlv::FragmentationIndicator::NotFragmented) {
+        return false;
+    }
+
+    MmtTlv::Common::ReadStream messageStream(signalingMessage.payload);
+    if (messageStream.leftBytes() < 2 ||
+        messageStream.peekBe16U() != static_cast<uint16_t>(MmtTlv::MmtMessageId::CaMessage)) {
+        return false;
+    }
+
+    MmtTlv::CaMessage message;
+    if (!message.unpack(messageStream) || messageStream.leftBytes() < 1 ||
+        messageStream.peek8U() != MmtTlv::MmtTableId::Ecm_0) {
+        return false;
+    }
+
+    MmtTlv::Ecm table;
+    if (!table.unpack(messageStream)) {
+        return false;
+    }
+
+    ecm = std::move(table.ecmData);
+    return true;
+}
+
+}
+
+EcmPrefetcher::EcmPrefetcher(std::shared_ptr<AcasEcmWorker> ecmWorker)
+    : ecmWorker(std::move(ecmWorker)) {
+}
+
+EcmPrefetcher::~EcmPrefetcher() {
+    stop();
+}
+
+bool EcmPrefetcher::start(const std::string& path) {
+    std::error_code ec;
+    if (path == "-" || !std::filesystem::is_regular_file(path, ec)) {
+        return false;
+    }
+
+    input = openInputSource(path, IoEngine::Auto, kChunkSize);
+    if (!input) {
+        return false;
+    }
+
+    running = true;
+    scannerThread = std::thread(&EcmPrefetcher::scanner, this);
+    return true;
+}
+
+void EcmPrefetcher::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        running = false;
+    }
+    cv.notify_all();
+
+    if (scannerThread.joinable()) {
+        scannerThread.join();
+    }
+
+    // Queued ECMs complete right away as stale, but their callbacks refer to this object.
+    std::unique_lock<std::mutex> lock(mutex);
+    cv.wait(lock, [&]() {
+        return inFlight == 0;
+    });
+}
+
+void EcmPrefetcher::setPosition(uint64_t position) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        this->position = position;
+    }
+    cv.notify_all();
+}
+
+void EcmPrefetcher::scanner() {
+    try {
+        while (running) {
+            std::span<const uint8_t> inputData = input->next();
+
+            size_t pos = 0;
+            while (inputData.size() - pos >= kTlvHeaderSize && running) {
+                std::span<const uint8_t> data = inputData.subspan(pos);
+                if (!isValidTlv(data)) {
+                    ++pos;
+                    continue;
+                }
+
+                size_t length = kTlvHeaderSize + ((data[2] << 8) | data[3]);
+                if (data.size() < length) {
+                    break;
+                }
+
+                std::vector<uint8_t> ecm;
+                if (parseEcm(data.first(length), ecm) && ecm != lastEcm) {
+                    submit(ecm);
+                    lastEcm = std::move(ecm);
+                }
+                pos += length;
+            }
+
+            input->consume(pos);
+            scannedBytes += pos;
+
+            if (pos == 0 && input->isEof()) {
+                break;
+            }
+
+            std::unique_lock<std::mutex> lock(mutex);
+            cv.wait(lock, [&]() {
+                return !running || scannedBytes <= position + kMaxLookahead;
+            });
+        }
+    }
+    catch (const std::exception& e) {
+        std::cerr << "ECM prefetcher: " << e.what() << std::endl;
+    }
+}
+
+void EcmPrefetcher::submit(const std::vector<uint8_t>& ecm) {
+    ++ecmCount;
+
+    EcmKeyCache* ecmKeyCache = ecmWorker->getEcmKeyCache();
+    if (ecmKeyCache && ecmKeyCache->peek(EcmKeyCache::hashEcm(ecm))) {
+        ++cachedCount;
+        return;
+    }
+
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        cv.wait(lock, [&]() {
+            return !running || inFlight < kMaxInFlight;
+        });
+        if (!running) {
+            return;
+        }
+        ++inFlight;
+    }
+
+    AcasEcmWorker::Request request;
+    request.ecm = ecm;
+    request.isStale = [this]() {
+        return !running;
+    };
+    request.onComplete = [this](std::optional<AcasCard::DecryptionKey> key) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (key) {
+            ++sentCount;
+        }
+        --inFlight;
+        // Notified under the lock, stop() may destroy this object as soon as inFlight drops to zero.
+        cv.notify_all();
+    };
+    ecmWorker->submit(std::move(request));
+}
+
+void EcmPrefetcher::printStatistics() const {
+    std::cerr << "ECM prefetcher:" << std::endl;
+    std::cerr << " - ECMs: " << ecmCount.load() << std::endl;
+    std::cerr << " - Already cached: " << cachedCount.load() << std::endl;
+    std::cerr << " - Prefetched: " << sentCount.load() << std::endl;
+}
@@ -0,0 +1,66 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <string>
+#include <thread>
+#include <vector>
+
+class AcasEcmWorker;
+class IInputSource;
+
+// Scans a file input ahead of the demuxer for ECMs and sends them to the ECM
+// worker early, so that the keys are in the worker's ECM key cache by the time
+// the demuxer reaches them and a key change no longer waits for the card.
+// The scanner reads the file through its own input source and only parses the
+// headers of control packets. It stays at most kMaxLookahead bytes ahead of
+// the position reported with setPosition() and keeps at most kMaxInFlight
+// ECMs queued, so that ECMs of the demuxer itself are not delayed much.
+class EcmPrefetcher {
+public:
+    explicit EcmPrefetcher(std::shared_ptr<AcasEcmWorker> ecmWorker);
+    ~EcmPrefetcher();
+
+    EcmPrefetcher(const EcmPrefetcher&) = delete;
+    EcmPrefetcher& operator=(const EcmPrefetcher&) = delete;
+
+    // Starts scanning a regular file. Returns false for stdin, pipes and files
+    // that cannot be opened.
+    bool start(const std::string& path);
+    // Stops scanning and waits for the ECMs already sent to the worker.
+    void stop();
+
+    // Number of input bytes the demuxer has consumed so far.
+    void setPosition(uint64_t position);
+
+    void printStatistics() const;
+
+private:
+    void scanner();
+    void submit(const std::vector<uint8_t>& ecm);
+
+    static constexpr size_t kChunkSize = 4 * 1024 * 1024;
+    static constexpr uint64_t kMaxLookahead = 256 * 1024 * 1024;
+    static constexpr size_t kMaxInFlight = 2;
+
+    std::shared_ptr<AcasEcmWorker> ecmWorker;
+    std::unique_ptr<IInputSource> input;
+    std::thread scannerThread;
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::atomic<bool> running{false};
+    uint64_t position{0};
+    size_t inFlight{0};
+
+    // Scanner state
+    uint64_t scannedBytes{0};
+    std::vector<uint8_t> lastEcm;
+
+    std::atomic<uint64_t> ecmCount{0};
+    std::atomic<uint64_t> cachedCount{0};
+    std::atomic<uint64_t> sentCount{0};
+};
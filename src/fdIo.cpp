@@ -0,0 +1,226 @@
+#include "fdIo.h"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <thread>
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#include <fcntl.h>
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+// Largest count passed to a single read/write call; _read and _write take an unsigned int.
+constexpr size_t kMaxTransfer = 1u << 30;
+
+}
+
+void setBinaryMode(int fd) {
+#ifdef _WIN32
+    _setmode(fd, _O_BINARY);
+#else
+    (void)fd;
+#endif
+}
+
+bool setPipeSize(int fd, size_t size) {
+#if defined(__linux__) && defined(F_SETPIPE_SZ)
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISFIFO(st.st_mode)) {
+        return true;
+    }
+
+    int current = fcntl(fd, F_GETPIPE_SZ);
+    if (current >= 0 && static_cast<size_t>(current) >= size) {
+        return true;
+    }
+    return fcntl(fd, F_SETPIPE_SZ, static_cast<int>(size)) >= 0;
+#else
+    (void)fd;
+    (void)size;
+    return true;
+#endif
+}
+
+size_t readFd(int fd, uint8_t* dst, size_t size) {
+    size = std::min(size, kMaxTransfer);
+    while (true) {
+#ifdef _WIN32
+        int ret = _read(fd, dst, static_cast<unsigned int>(size));
+#else
+        ssize_t ret = ::read(fd, dst, size);
+#endif
+        if (ret >= 0) {
+            return static_cast<size_t>(ret);
+        }
+        if (errno == EINTR) {
+            continue;
+        }
+
+        std::cerr << "Input read failed: " << strerror(errno) << std::endl;
+        return 0;
+    }
+}
+
+CancellableFdReader::CancellableFdReader(int fd)
+    : fd(fd) {
+#ifndef _WIN32
+    if (pipe(wakeFds) != 0) {
+        // Without the pipe a blocked read cannot be woken up, it still reads normally.
+        wakeFds[0] = -1;
+        wakeFds[1] = -1;
+    }
+#endif
+}
+
+CancellableFdReader::~CancellableFdReader() {
+#ifndef _WIN32
+    if (wakeFds[0] >= 0) {
+        ::close(wakeFds[0]);
+        ::close(wakeFds[1]);
+    }
+#endif
+}
+
+size_t CancellableFdReader::read(uint8_t* dst, size_t size) {
+#ifdef _WIN32
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (cancelled) {
+            return 0;
+        }
+        readingThread = OpenThread(THREAD_TERMINATE, FALSE, GetCurrentThreadId());
+    }
+
+    int ret = _read(fd, dst, static_cast<unsigned int>(std::min(size, kMaxTransfer)));
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (readingThread) {
+            CloseHandle(readingThread);
+            readingThread = nullptr;
+        }
+    }
+
+    if (ret < 0 || cancelled) {
+        if (ret < 0 && !cancelled) {
+            std::cerr << "Input read failed: " << strerror(errno) << std::endl;
+        }
+        return 0;
+    }
+    return static_cast<size_t>(ret);
+#else
+    pollfd fds[2] = {
+        { fd, POLLIN, 0 },
+        { wakeFds[0], POLLIN, 0 },
+    };
+    while (!cancelled) {
+        // A negative descriptor is ignored by poll.
+        if (poll(fds, 2, -1) >= 0 || errno != EINTR) {
+            break;
+        }
+    }
+
+    if (cancelled) {
+        return 0;
+    }
+    return readFd(fd, dst, size);
+#endif
+}
+
+void CancellableFdReader::cancel() {
+    cancelled = true;
+
+#ifdef _WIN32
+    // CancelSynchronousIo only aborts a read that has already started, retry
+    // until the reading thread has left read().
+    while (true) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!readingThread) {
+                break;
+            }
+            CancelSynchronousIo(readingThread);
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+#else
+    if (wakeFds[1] >= 0) {
+        char byte = 0;
+        [[maybe_unused]] ssize_t ret = ::write(wakeFds[1], &byte, 1);
+    }
+#endif
+}
+
+FdOutput::FdOutput(int fd)
+    : fd(fd) {
+    buffer.resize(kBufferSize);
+}
+
+FdOutput::~FdOutput() {
+    flush();
+}
+
+void FdOutput::write(const uint8_t* data, size_t size) {
+    while (size > 0) {
+        size_t length = std::min(size, kBufferSize - offset);
+        memcpy(buffer.data() + offset, data, length);
+        offset += length;
+        data += length;
+        size -= length;
+
+        if (offset == kBufferSize) {
+            flush();
+        }
+    }
+}
+
+std::span<uint8_t> FdOutput::reserve(size_t size) {
+    if (offset + size > kBufferSize) {
+        flush();
+    }
+    return { buffer.data() + offset, size };
+}
+
+void FdOutput::commit(size_t size) {
+    offset += size;
+}
+
+void FdOutput::flush() {
+    const uint8_t* data = buffer.data();
+    size_t size = offset;
+    offset = 0;
+
+    while (size > 0 && !failed) {
+        size_t length = std::min(size, kMaxTransfer);
+#ifdef _WIN32
+        int ret = _write(fd, data, static_cast<unsigned int>(length));
+#else
+        ssize_t ret = ::write(fd, data, length);
+#endif
+        if (ret < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            // The reader went away or the disk is full, drop the rest of the output.
+            std::cerr << "Output write failed: " << strerror(errno) << std::endl;
+            failed = true;
+            break;
+        }
+
+        data += ret;
+        size -= static_cast<size_t>(ret);
+    }
+}
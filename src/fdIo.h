@@ -0,0 +1,76 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+#include "output.h"
+
+// Raw file descriptor I/O for stdin/stdout, bypassing iostreams.
+
+constexpr int kStdinFd = 0;
+constexpr int kStdoutFd = 1;
+
+// Puts the descriptor into binary mode (no-op outside Windows).
+void setBinaryMode(int fd);
+
+// Grows the pipe buffer behind fd to at least size bytes with F_SETPIPE_SZ.
+// Returns true if fd is not a pipe or the platform has no such control,
+// false if the kernel refused the size.
+bool setPipeSize(int fd, size_t size);
+
+// Reads up to size bytes from fd, retrying on EINTR.
+// Returns the number of bytes read, 0 at end of input or on error.
+size_t readFd(int fd, uint8_t* dst, size_t size);
+
+// Reads from fd like readFd, but a read that is blocked waiting for input on
+// a pipe or terminal can be abandoned from another thread with cancel().
+class CancellableFdReader {
+public:
+    explicit CancellableFdReader(int fd);
+    ~CancellableFdReader();
+
+    CancellableFdReader(const CancellableFdReader&) = delete;
+    CancellableFdReader& operator=(const CancellableFdReader&) = delete;
+
+    // Returns 0 at end of input, on error and once cancel() has been called.
+    size_t read(uint8_t* dst, size_t size);
+    void cancel();
+
+private:
+    int fd;
+    std::atomic<bool> cancelled{false};
+#ifdef _WIN32
+    // The thread inside read(), target of CancelSynchronousIo.
+    std::mutex mutex;
+    void* readingThread{nullptr};
+#else
+    // Self-pipe polled together with fd.
+    int wakeFds[2]{ -1, -1 };
+#endif
+};
+
+// Collects the output into a large buffer and writes it to fd with as few
+// write calls as possible.
+class FdOutput : public IOutput {
+public:
+    explicit FdOutput(int fd);
+    ~FdOutput();
+
+    FdOutput(const FdOutput&) = delete;
+    FdOutput& operator=(const FdOutput&) = delete;
+
+    void write(const uint8_t* data, size_t size) override;
+    std::span<uint8_t> reserve(size_t size) override;
+    void commit(size_t size) override;
+    void flush() override;
+    bool hasFailed() const override { return failed; }
+
+private:
+    static constexpr size_t kBufferSize = 1024 * 1024;
+
+    int fd;
+    std::vector<uint8_t> buffer;
+    size_t offset{0};
+    bool failed{false};
+};
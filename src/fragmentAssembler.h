@@ -1,4 +1,5 @@
 #pragma once
+#include <span>
 #include <vector>
 #include <cstdint>
 #include "mmtFragment.h"
@@ -24,7 +25,7 @@ private:
 
 class FragmentAssembler {
 public:
-	bool assemble(const std::vector<uint8_t>& fragment, FragmentationIndicator fragmentationIndicator, uint32_t packetSequenceNumber);
+	bool assemble(std::span<const uint8_t> fragment, FragmentationIndicator fragmentationIndicator, uint32_t packetSequenceNumber);
 	void checkState(uint32_t packetSequenceNumber);
 	void clear();
 
@@ -0,0 +1,198 @@
+#include "inputRing.h"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+size_t getAllocationGranularity() {
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwAllocationGranularity;
+#else
+    return static_cast<size_t>(sysconf(_SC_PAGESIZE));
+#endif
+}
+
+#ifdef _WIN32
+// VirtualAlloc2 and MapViewOfFile3 are only available on Windows 10 1803 or later.
+using FnVirtualAlloc2 = PVOID(WINAPI*)(HANDLE, PVOID, SIZE_T, ULONG, ULONG, MEM_EXTENDED_PARAMETER*, ULONG);
+using FnMapViewOfFile3 = PVOID(WINAPI*)(HANDLE, HANDLE, PVOID, ULONG64, SIZE_T, ULONG, ULONG, MEM_EXTENDED_PARAMETER*, ULONG);
+#endif
+
+}
+
+InputRing::InputRing(size_t capacity) {
+    size_t granularity = getAllocationGranularity();
+    ringCapacity = (std::max<size_t>(capacity, 1) + granularity - 1) / granularity * granularity;
+
+    if (allocateMirrored()) {
+        mirrored = true;
+        return;
+    }
+
+    base = new uint8_t[ringCapacity];
+}
+
+InputRing::~InputRing() {
+    if (mirrored) {
+        releaseMirrored();
+    }
+    else {
+        delete[] base;
+    }
+}
+
+std::span<uint8_t> InputRing::prepare(size_t size) {
+    size = std::min(size, freeSpace());
+
+    if (!mirrored && readOffset + count + size > ringCapacity) {
+        memmove(base, base + readOffset, count);
+        readOffset = 0;
+    }
+
+    size_t writeOffset = readOffset + count;
+    if (mirrored && writeOffset >= ringCapacity) {
+        writeOffset -= ringCapacity;
+    }
+
+    return { base + writeOffset, size };
+}
+
+void InputRing::commit(size_t size) {
+    if (size > freeSpace()) {
+        throw std::out_of_range("InputRing commit exceeds free space");
+    }
+    count += size;
+}
+
+void InputRing::consume(size_t size) {
+    if (size > count) {
+        throw std::out_of_range("InputRing consume exceeds readable size");
+    }
+
+    count -= size;
+    if (count == 0) {
+        readOffset = 0;
+        return;
+    }
+
+    readOffset += size;
+    if (mirrored && readOffset >= ringCapacity) {
+        readOffset -= ringCapacity;
+    }
+}
+
+void InputRing::clear() {
+    readOffset = 0;
+    count = 0;
+}
+
+#ifdef _WIN32
+bool InputRing::allocateMirrored() {
+    HMODULE hKernelBase = GetModuleHandleA("kernelbase.dll");
+    if (!hKernelBase) {
+        return false;
+    }
+
+    auto pVirtualAlloc2 = reinterpret_cast<FnVirtualAlloc2>(GetProcAddress(hKernelBase, "VirtualAlloc2"));
+    auto pMapViewOfFile3 = reinterpret_cast<FnMapViewOfFile3>(GetProcAddress(hKernelBase, "MapViewOfFile3"));
+    if (!pVirtualAlloc2 || !pMapViewOfFile3) {
+        return false;
+    }
+
+    uint8_t* placeholder = static_cast<uint8_t*>(pVirtualAlloc2(nullptr, nullptr, ringCapacity * 2,
+        MEM_RESERVE | MEM_RESERVE_PLACEHOLDER, PAGE_NOACCESS, nullptr, 0));
+    if (!placeholder) {
+        return false;
+    }
+
+    // Split the reservation into two placeholders, one for each view.
+    if (!VirtualFree(placeholder, ringCapacity, MEM_RELEASE | MEM_PRESERVE_PLACEHOLDER)) {
+        VirtualFree(placeholder, 0, MEM_RELEASE);
+        return false;
+    }
+
+    HANDLE hSection = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE,
+        static_cast<DWORD>(static_cast<uint64_t>(ringCapacity) >> 32), static_cast<DWORD>(ringCapacity), nullptr);
+    if (!hSection) {
+        VirtualFree(placeholder, 0, MEM_RELEASE);
+        VirtualFree(placeholder + ringCapacity, 0, MEM_RELEASE);
+        return false;
+    }
+
+    void* view1 = pMapViewOfFile3(hSection, nullptr, placeholder, 0, ringCapacity,
+        MEM_REPLACE_PLACEHOLDER, PAGE_READWRITE, nullptr, 0);
+    if (!view1) {
+        CloseHandle(hSection);
+        VirtualFree(placeholder, 0, MEM_RELEASE);
+        VirtualFree(placeholder + ringCapacity, 0, MEM_RELEASE);
+        return false;
+    }
+
+    void* view2 = pMapViewOfFile3(hSection, nullptr, placeholder + ringCapacity, 0, ringCapacity,
+        MEM_REPLACE_PLACEHOLDER, PAGE_READWRITE, nullptr, 0);
+    CloseHandle(hSection);
+    if (!view2) {
+        UnmapViewOfFile(view1);
+        VirtualFree(placeholder + ringCapacity, 0, MEM_RELEASE);
+        return false;
+    }
+
+    base = placeholder;
+    return true;
+}
+
+void InputRing::releaseMirrored() {
+    UnmapViewOfFile(base);
+    UnmapViewOfFile(base + ringCapacity);
+    base = nullptr;
+}
+#else
+bool InputRing::allocateMirrored() {
+    int fd = memfd_create("dantto4k-input", MFD_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+
+    if (ftruncate(fd, static_cast<off_t>(ringCapacity)) != 0) {
+        ::close(fd);
+        return false;
+    }
+
+    // Reserve twice the capacity, then map the same pages into both halves.
+    void* reserved = mmap(nullptr, ringCapacity * 2, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (reserved == MAP_FAILED) {
+        ::close(fd);
+        return false;
+    }
+
+    uint8_t* address = static_cast<uint8_t*>(reserved);
+    void* view1 = mmap(address, ringCapacity, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0);
+    void* view2 = mmap(address + ringCapacity, ringCapacity, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0);
+    ::close(fd);
+
+    if (view1 == MAP_FAILED || view2 == MAP_FAILED) {
+        munmap(reserved, ringCapacity * 2);
+        return false;
+    }
+
+    base = address;
+    return true;
+}
+
+void InputRing::releaseMirrored() {
+    munmap(base, ringCapacity * 2);
+    base = nullptr;
+}
+#endif
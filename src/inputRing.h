@@ -0,0 +1,42 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <span>
+
+// Fixed-capacity byte ring used to stage input for the demuxer.
+// When the platform allows it the storage is mapped twice back to back, so the
+// readable region is always contiguous even when it wraps around the end of
+// the ring and consuming bytes never moves any data. Otherwise a linear buffer
+// is used that is compacted only when the free space at its tail runs out.
+class InputRing {
+public:
+    explicit InputRing(size_t capacity);
+    ~InputRing();
+
+    InputRing(const InputRing&) = delete;
+    InputRing& operator=(const InputRing&) = delete;
+
+    // Bytes that have been committed but not consumed yet.
+    std::span<const uint8_t> data() const { return { base + readOffset, count }; }
+    size_t size() const { return count; }
+    size_t capacity() const { return ringCapacity; }
+    size_t freeSpace() const { return ringCapacity - count; }
+    bool isMirrored() const { return mirrored; }
+
+    // Returns a contiguous writable region of up to size bytes.
+    // The region is empty when the ring is full.
+    std::span<uint8_t> prepare(size_t size);
+    void commit(size_t size);
+    void consume(size_t size);
+    void clear();
+
+private:
+    bool allocateMirrored();
+    void releaseMirrored();
+
+    uint8_t* base{nullptr};
+    size_t ringCapacity{0};
+    size_t readOffset{0};
+    size_t count{0};
+    bool mirrored{false};
+};
@@ -0,0 +1,449 @@
+#include "inputSource.h"
+#include "fdIo.h"
+#include "uringIo.h"
+#include <algorithm>
+#include <cstring>
+#include <iomanip>
+#include <stdexcept>
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+uint64_t getPageSize() {
+    static uint64_t pageSize = []() -> uint64_t {
+#ifdef _WIN32
+        SYSTEM_INFO info;
+        GetSystemInfo(&info);
+        return info.dwPageSize;
+#else
+        return static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+#endif
+    }();
+    return pageSize;
+}
+
+std::unique_ptr<std::ifstream> openFileStream(const std::string& path, uint64_t& size) {
+    auto fs = std::make_unique<std::ifstream>(path, std::ios::binary);
+    if (!fs->is_open()) {
+        return nullptr;
+    }
+
+    // Pipes and character devices cannot be seeked, their size stays unknown.
+    fs->seekg(0, std::ios::end);
+    auto end = fs->tellg();
+    if (end < 0) {
+        fs->clear();
+        size = 0;
+        return fs;
+    }
+
+    size = static_cast<uint64_t>(end);
+    fs->seekg(0, std::ios::beg);
+    return fs;
+}
+
+ReadAheadInputSource::ReadFunction makeStreamReadFunction(std::shared_ptr<std::istream> stream) {
+    return [stream](uint8_t* dst, size_t size) -> size_t {
+        if (!stream->good()) {
+            return 0;
+        }
+        stream->read(reinterpret_cast<char*>(dst), size);
+        return static_cast<size_t>(stream->gcount());
+    };
+}
+
+}
+
+std::optional<IoEngine> parseIoEngine(const std::string& name) {
+    if (name == "auto") {
+        return IoEngine::Auto;
+    }
+    if (name == "mmap") {
+        return IoEngine::Mmap;
+    }
+    if (name == "stream") {
+        return IoEngine::Stream;
+    }
+    if (name == "readahead") {
+        return IoEngine::ReadAhead;
+    }
+    if (name == "uring") {
+        return IoEngine::Uring;
+    }
+    return std::nullopt;
+}
+
+StreamInputSource::StreamInputSource(std::istream& stream, size_t chunkSize)
+    : stream(stream), chunkSize(chunkSize), ring(chunkSize * 2) {
+}
+
+StreamInputSource::StreamInputSource(std::unique_ptr<std::istream> stream, size_t chunkSize, uint64_t size)
+    : ownedStream(std::move(stream)), stream(*ownedStream), chunkSize(chunkSize), size(size), ring(chunkSize * 2) {
+}
+
+std::span<const uint8_t> StreamInputSource::next() {
+    if (ring.size() < chunkSize && stream.good()) {
+        std::span<uint8_t> dst = ring.prepare(chunkSize);
+        stream.read(reinterpret_cast<char*>(dst.data()), dst.size());
+        ring.commit(static_cast<size_t>(stream.gcount()));
+    }
+
+    return ring.data();
+}
+
+void StreamInputSource::consume(size_t size) {
+    ring.consume(size);
+}
+
+bool StreamInputSource::isEof() const {
+    return !stream.good();
+}
+
+FdInputSource::FdInputSource(int fd, size_t chunkSize)
+    : fd(fd), chunkSize(chunkSize), ring(chunkSize * 2) {
+    setBinaryMode(fd);
+}
+
+std::span<const uint8_t> FdInputSource::next() {
+    // A pipe returns at most its buffer size per read, demux whatever arrived.
+    if (ring.size() < chunkSize && !eof) {
+        std::span<uint8_t> dst = ring.prepare(chunkSize);
+        size_t bytesRead = readFd(fd, dst.data(), dst.size());
+        ring.commit(bytesRead);
+        eof = bytesRead == 0;
+    }
+
+    return ring.data();
+}
+
+void FdInputSource::consume(size_t size) {
+    ring.consume(size);
+}
+
+bool FdInputSource::isEof() const {
+    return eof;
+}
+
+MappedFileInputSource::MappedFileInputSource(size_t windowSize)
+    : windowSize(windowSize) {
+}
+
+MappedFileInputSource::~MappedFileInputSource() {
+    close();
+}
+
+bool MappedFileInputSource::open(const std::string& path) {
+    close();
+
+#ifdef _WIN32
+    HANDLE hFile = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr,
+        OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (hFile == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+
+    LARGE_INTEGER fileSize;
+    if (GetFileType(hFile) != FILE_TYPE_DISK || !GetFileSizeEx(hFile, &fileSize) || fileSize.QuadPart <= 0 ||
+        static_cast<uint64_t>(fileSize.QuadPart) > SIZE_MAX) {
+        CloseHandle(hFile);
+        return false;
+    }
+
+    HANDLE hMapping = CreateFileMappingA(hFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    CloseHandle(hFile);
+    if (hMapping == nullptr) {
+        return false;
+    }
+
+    // The view keeps its own reference to the mapping object.
+    void* view = MapViewOfFile(hMapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(hMapping);
+    if (view == nullptr) {
+        return false;
+    }
+
+    size = static_cast<uint64_t>(fileSize.QuadPart);
+#else
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size <= 0 ||
+        static_cast<uint64_t>(st.st_size) > SIZE_MAX) {
+        ::close(fd);
+        return false;
+    }
+
+    // The mapping stays valid after the descriptor is closed.
+    void* view = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (view == MAP_FAILED) {
+        return false;
+    }
+
+    size = static_cast<uint64_t>(st.st_size);
+    madvise(view, static_cast<size_t>(size), MADV_SEQUENTIAL);
+#endif
+
+    data = static_cast<const uint8_t*>(view);
+    pos = 0;
+    releasedPos = 0;
+    return true;
+}
+
+void MappedFileInputSource::close() {
+    if (data == nullptr) {
+        return;
+    }
+
+#ifdef _WIN32
+    UnmapViewOfFile(data);
+#else
+    munmap(const_cast<uint8_t*>(data), static_cast<size_t>(size));
+#endif
+    data = nullptr;
+    size = 0;
+    pos = 0;
+    releasedPos = 0;
+}
+
+std::span<const uint8_t> MappedFileInputSource::next() {
+    size_t length = static_cast<size_t>(std::min<uint64_t>(windowSize, size - pos));
+    return { data + pos, length };
+}
+
+void MappedFileInputSource::consume(size_t size) {
+    pos += size;
+    if (pos - releasedPos >= kReleaseInterval) {
+        release(pos);
+    }
+}
+
+bool MappedFileInputSource::isEof() const {
+    return pos + windowSize >= size;
+}
+
+void MappedFileInputSource::release(uint64_t end) {
+    end &= ~(getPageSize() - 1);
+    if (end <= releasedPos) {
+        return;
+    }
+
+    // Drop the already demuxed pages so that the resident set does not grow with the file.
+#ifdef _WIN32
+    // VirtualUnlock on pages that are not locked removes them from the working set.
+    VirtualUnlock(const_cast<uint8_t*>(data + releasedPos), static_cast<size_t>(end - releasedPos));
+#else
+    madvise(const_cast<uint8_t*>(data + releasedPos), static_cast<size_t>(end - releasedPos), MADV_DONTNEED);
+#endif
+    releasedPos = end;
+}
+
+void ReadAheadInputSource::AlignedDelete::operator()(uint8_t* p) const {
+    ::operator delete[](p, std::align_val_t(kAlignment));
+}
+
+ReadAheadInputSource::ReadAheadInputSource(ReadFunction read, size_t chunkSize, size_t queueDepth, uint64_t size, CancelFunction cancel)
+    : read(std::move(read)), cancel(std::move(cancel)), chunkSize(chunkSize), size(size) {
+    // One extra buffer is held by the demuxer while the reader fills the others.
+    buffers.resize(queueDepth + 1);
+    for (size_t i = 0; i < buffers.size(); ++i) {
+        uint8_t* memory = static_cast<uint8_t*>(::operator new[](kCarrySize + chunkSize, std::align_val_t(kAlignment)));
+        buffers[i].memory.reset(memory);
+        freeQueue.push(i);
+    }
+
+    readerThread = std::thread(&ReadAheadInputSource::reader, this);
+}
+
+ReadAheadInputSource::~ReadAheadInputSource() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        running = false;
+    }
+
+    cv.notify_all();
+    // The reader may be blocked in a read from stdin that never completes.
+    if (cancel) {
+        cancel();
+    }
+    if (readerThread.joinable()) {
+        readerThread.join();
+    }
+}
+
+std::span<const uint8_t> ReadAheadInputSource::next() {
+    size_t index;
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (filledQueue.empty() && !readerDone) {
+            auto start = std::chrono::steady_clock::now();
+            cv.wait(lock, [&]() {
+                return !filledQueue.empty() || readerDone;
+            });
+            demuxerWaitTime += std::chrono::steady_clock::now() - start;
+        }
+
+        if (filledQueue.empty()) {
+            return { viewBegin, viewSize };
+        }
+
+        index = filledQueue.front();
+        filledQueue.pop();
+    }
+
+    if (viewSize > kCarrySize) {
+        throw std::runtime_error("Unconsumed input exceeds the read-ahead carry size");
+    }
+
+    // Move the unconsumed tail in front of the new chunk.
+    uint8_t* chunk = buffers[index].memory.get() + kCarrySize;
+    if (viewSize > 0) {
+        memcpy(chunk - viewSize, viewBegin, viewSize);
+    }
+    viewBegin = chunk - viewSize;
+    viewSize += buffers[index].length;
+
+    if (current) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            freeQueue.push(*current);
+        }
+        cv.notify_all();
+    }
+    current = index;
+
+    return { viewBegin, viewSize };
+}
+
+void ReadAheadInputSource::consume(size_t size) {
+    viewBegin += size;
+    viewSize -= size;
+}
+
+bool ReadAheadInputSource::isEof() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return readerDone && filledQueue.empty();
+}
+
+void ReadAheadInputSource::printStatistics() const {
+    auto toSeconds = [](std::chrono::steady_clock::duration d) {
+        return std::chrono::duration<double>(d).count();
+    };
+
+    std::lock_guard<std::mutex> lock(mutex);
+    std::cerr << "Input:" << std::endl;
+    std::cerr << " - Demuxer waited on I/O: " << std::fixed << std::setprecision(3) << toSeconds(demuxerWaitTime) << "s" << std::endl;
+    std::cerr << " - I/O waited on demuxer: " << std::fixed << std::setprecision(3) << toSeconds(readerWaitTime) << "s" << std::endl;
+}
+
+void ReadAheadInputSource::reader() {
+    while (true) {
+        size_t index;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            if (freeQueue.empty() && running) {
+                auto start = std::chrono::steady_clock::now();
+                cv.wait(lock, [&]() {
+                    return !freeQueue.empty() || !running;
+                });
+                readerWaitTime += std::chrono::steady_clock::now() - start;
+            }
+
+            if (!running) {
+                break;
+            }
+
+            index = freeQueue.front();
+            freeQueue.pop();
+        }
+
+        uint8_t* chunk = buffers[index].memory.get() + kCarrySize;
+        size_t length = 0;
+        while (length < chunkSize) {
+            size_t bytesRead = read(chunk + length, chunkSize - length);
+            if (bytesRead == 0) {
+                break;
+            }
+            length += bytesRead;
+        }
+
+        bool eof = length < chunkSize;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            buffers[index].length = length;
+            filledQueue.push(index);
+            readerDone = eof;
+        }
+        cv.notify_all();
+
+        if (eof) {
+            break;
+        }
+    }
+}
+
+std::unique_ptr<IInputSource> openInputSource(const std::string& path, IoEngine engine, size_t chunkSize) {
+    constexpr size_t readAheadDepth = 3;
+
+    if (path == "-") {
+        if (engine == IoEngine::Mmap) {
+            std::cerr << "stdin cannot be memory-mapped" << std::endl;
+            return nullptr;
+        }
+        if (engine == IoEngine::ReadAhead) {
+            setBinaryMode(kStdinFd);
+            auto reader = std::make_shared<CancellableFdReader>(kStdinFd);
+            auto read = [reader](uint8_t* dst, size_t size) {
+                return reader->read(dst, size);
+            };
+            auto cancel = [reader]() {
+                reader->cancel();
+            };
+            return std::make_unique<ReadAheadInputSource>(read, chunkSize, readAheadDepth, 0, cancel);
+        }
+        return std::make_unique<FdInputSource>(kStdinFd, chunkSize);
+    }
+
+    if (engine == IoEngine::Uring) {
+        if (auto uring = openUringInputSource(path, chunkSize)) {
+            return uring;
+        }
+        std::cerr << "Unable to read the input file with io_uring, falling back to stream I/O: " << path << std::endl;
+    }
+
+    if (engine == IoEngine::Auto || engine == IoEngine::Mmap) {
+        auto mapped = std::make_unique<MappedFileInputSource>(chunkSize);
+        if (mapped->open(path)) {
+            return mapped;
+        }
+        if (engine == IoEngine::Mmap) {
+            std::cerr << "Unable to memory-map the input file: " << path << std::endl;
+            return nullptr;
+        }
+    }
+
+    uint64_t size = 0;
+    auto fs = openFileStream(path, size);
+    if (!fs) {
+        return nullptr;
+    }
+
+    if (engine == IoEngine::ReadAhead) {
+        return std::make_unique<ReadAheadInputSource>(makeStreamReadFunction(std::move(fs)), chunkSize, readAheadDepth, size);
+    }
+
+    return std::make_unique<StreamInputSource>(std::move(fs), chunkSize, size);
+}
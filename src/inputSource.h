@@ -0,0 +1,178 @@
+#pragma once
+#include <cstdint>
+#include <iostream>
+#include <fstream>
+#include <memory>
+#include <span>
+#include <string>
+#include <vector>
+#include <queue>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <optional>
+#include <functional>
+#include <condition_variable>
+#include "inputRing.h"
+
+enum class IoEngine {
+    Auto,
+    Mmap,
+    Stream,
+    ReadAhead,
+    Uring,
+};
+
+std::optional<IoEngine> parseIoEngine(const std::string& name);
+
+// Source of MMT/TLV input bytes for the conversion loop.
+// next() returns every byte that has not been consumed yet, pulling in more
+// data from the underlying input when needed. The returned view stays valid
+// until the next call to next() or consume().
+class IInputSource {
+public:
+    virtual ~IInputSource() = default;
+    virtual std::span<const uint8_t> next() = 0;
+    virtual void consume(size_t size) = 0;
+    virtual bool isEof() const = 0;
+
+    // Total size of the input in bytes, or 0 when unknown (stdin, pipes).
+    virtual uint64_t getSize() const { return 0; }
+    virtual void printStatistics() const {}
+};
+
+// Reads the input through std::istream in fixed-size chunks into an InputRing.
+class StreamInputSource : public IInputSource {
+public:
+    StreamInputSource(std::istream& stream, size_t chunkSize);
+    StreamInputSource(std::unique_ptr<std::istream> stream, size_t chunkSize, uint64_t size);
+    std::span<const uint8_t> next() override;
+    void consume(size_t size) override;
+    bool isEof() const override;
+    uint64_t getSize() const override { return size; }
+
+private:
+    std::unique_ptr<std::istream> ownedStream;
+    std::istream& stream;
+    size_t chunkSize;
+    uint64_t size{0};
+    InputRing ring;
+};
+
+// Reads the input straight from a file descriptor (stdin, pipes) into an
+// InputRing, without going through iostreams.
+class FdInputSource : public IInputSource {
+public:
+    FdInputSource(int fd, size_t chunkSize);
+    std::span<const uint8_t> next() override;
+    void consume(size_t size) override;
+    bool isEof() const override;
+
+private:
+    int fd;
+    size_t chunkSize;
+    bool eof{false};
+    InputRing ring;
+};
+
+// Maps a regular file read-only and hands out views straight into the mapping.
+// Consumed pages are released periodically so that RSS stays bounded
+// regardless of the file size.
+class MappedFileInputSource : public IInputSource {
+public:
+    explicit MappedFileInputSource(size_t windowSize);
+    ~MappedFileInputSource();
+
+    MappedFileInputSource(const MappedFileInputSource&) = delete;
+    MappedFileInputSource& operator=(const MappedFileInputSource&) = delete;
+
+    // Returns false if the file is not a regular file or cannot be mapped.
+    bool open(const std::string& path);
+    void close();
+
+    std::span<const uint8_t> next() override;
+    void consume(size_t size) override;
+    bool isEof() const override;
+    uint64_t getSize() const override { return size; }
+
+private:
+    void release(uint64_t end);
+
+    static constexpr uint64_t kReleaseInterval = 64 * 1024 * 1024;
+
+    size_t windowSize;
+    const uint8_t* data{nullptr};
+    uint64_t size{0};
+    uint64_t pos{0};
+    uint64_t releasedPos{0};
+};
+
+// Reads the input on a separate thread into a bounded queue of aligned buffers,
+// keeping up to queueDepth chunks ahead of the demuxer so that I/O latency is
+// hidden behind demuxing. The tail of a chunk that the demuxer could not
+// consume is copied into the headroom in front of the next chunk so that a
+// TLV packet spanning two chunks is still contiguous.
+class ReadAheadInputSource : public IInputSource {
+public:
+    // Reads up to size bytes into dst and returns the number of bytes read, 0 on end of input.
+    using ReadFunction = std::function<size_t(uint8_t* dst, size_t size)>;
+    // Makes a read blocked on the reader thread return 0, called before joining it.
+    using CancelFunction = std::function<void()>;
+
+    ReadAheadInputSource(ReadFunction read, size_t chunkSize, size_t queueDepth, uint64_t size = 0, CancelFunction cancel = nullptr);
+    ~ReadAheadInputSource();
+
+    ReadAheadInputSource(const ReadAheadInputSource&) = delete;
+    ReadAheadInputSource& operator=(const ReadAheadInputSource&) = delete;
+
+    std::span<const uint8_t> next() override;
+    void consume(size_t size) override;
+    bool isEof() const override;
+    uint64_t getSize() const override { return size; }
+    void printStatistics() const override;
+
+private:
+    struct AlignedDelete {
+        void operator()(uint8_t* p) const;
+    };
+
+    struct Buffer {
+        std::unique_ptr<uint8_t, AlignedDelete> memory;
+        size_t length{0};
+    };
+
+    void reader();
+
+    static constexpr size_t kAlignment = 4096;
+    // Room in front of every chunk for the unconsumed tail of the previous one.
+    // A TLV packet is at most 65539 bytes long.
+    static constexpr size_t kCarrySize = 256 * 1024;
+
+    ReadFunction read;
+    CancelFunction cancel;
+    size_t chunkSize;
+    uint64_t size;
+    std::vector<Buffer> buffers;
+    std::queue<size_t> filledQueue;
+    std::queue<size_t> freeQueue;
+    mutable std::mutex mutex;
+    std::condition_variable cv;
+    bool running{true};
+    bool readerDone{false};
+
+    std::optional<size_t> current;
+    const uint8_t* viewBegin{nullptr};
+    size_t viewSize{0};
+
+    std::chrono::steady_clock::duration demuxerWaitTime{};
+    std::chrono::steady_clock::duration readerWaitTime{};
+    std::thread readerThread;
+};
+
+// Opens the input with the given I/O engine. path "-" selects stdin.
+// Auto maps regular files and falls back to std::istream for pipes and files
+// that cannot be mapped. stdin is read from its file descriptor directly.
+// Uring falls back to std::istream likewise, with a notice. Mmap fails
+// instead of falling back, including for stdin.
+// Returns nullptr if the input cannot be opened.
+std::unique_ptr<IInputSource> openInputSource(const std::string& path, IoEngine engine, size_t chunkSize);
@@ -4,59 +4,59 @@ namespace MmtTlv {
 
 bool IPv6Header::unpack(Common::ReadStream& stream)
 {
-	try {
-		uint16_t uint16 = stream.getBe16U();
-		version = (uint16 & 0b1111000000000000) >> 12;
-		priority = (uint16 & 0b0000111111110000) >> 4;
-		flow_lbl = (uint16 & 0b0000000000001111) << 16;
-
-		uint16 = stream.getBe16U();
-		flow_lbl |= uint16;
+	auto header = stream.getHeader(isCompressed ? 38 : 40);
+	if (!header) {
+		return false;
+	}
 
-		if (!isCompressed) {
-			payloadLength = stream.getBe16U();
-		}
+	uint16_t uint16 = header->getBe16U();
+	version = (uint16 & 0b1111000000000000) >> 12;
+	priority = (uint16 & 0b0000111111110000) >> 4;
+	flow_lbl = (uint16 & 0b0000000000001111) << 16;
 
-		nexthdr = stream.get8U();
-		hop_limit = stream.get8U();
+	uint16 = header->getBe16U();
+	flow_lbl |= uint16;
 
-		stream.read(saddr.in6_u.u6_addr8, 16);
-		stream.read(daddr.in6_u.u6_addr8, 16);
-	}
-	catch (const std::out_of_range&) {
-		return false;
+	if (!isCompressed) {
+		payloadLength = header->getBe16U();
 	}
 
+	nexthdr = header->get8U();
+	hop_limit = header->get8U();
+
+	header->read(saddr.in6_u.u6_addr8, 16);
+	header->read(daddr.in6_u.u6_addr8, 16);
+
 	return true;
 }
 
 bool IPv6ExtensionHeader::unpack(Common::ReadStream& stream, bool headerLengthOnly)
 {
-	try {
-		if (!headerLengthOnly) {
-			next_header = stream.get8U();
-		}
-		header_length = stream.get8U();
-	}
-	catch (const std::out_of_range&) {
+	auto header = stream.getHeader(headerLengthOnly ? 1 : 2);
+	if (!header) {
 		return false;
 	}
 
+	if (!headerLengthOnly) {
+		next_header = header->get8U();
+	}
+	header_length = header->get8U();
+
 	return true;
 }
 
 bool UDPHeader::unpack(Common::ReadStream& stream, bool headerLengthOnly)
 {
-	try {
-		source_port = stream.getBe16U();
-		destination_port = stream.getBe16U();
-		length = stream.getBe16U();
-		checksum = stream.getBe16U();
-	}
-	catch (const std::out_of_range&) {
+	auto header = stream.getHeader(8);
+	if (!header) {
 		return false;
 	}
 
+	source_port = header->getBe16U();
+	destination_port = header->getBe16U();
+	length = header->getBe16U();
+	checksum = header->getBe16U();
+
 	return true;
 }
 
@@ -44,6 +44,10 @@ void MmtTlvDemuxer::setCasHandler(std::unique_ptr<CasHandler> handler) {
 }
 
 DemuxStatus MmtTlvDemuxer::demux(Common::ReadStream& stream) {
+    if (!heldPackets.empty()) {
+        releaseHeldPackets(false);
+    }
+
     size_t cur = stream.getPos();
 
     if (stream.leftBytes() < 4) {
@@ -55,16 +59,12 @@ DemuxStatus MmtTlvDemuxer::demux(Common::ReadStream& stream) {
         return DemuxStatus::NotValidTlv;
     }
 
+    // Fails without consuming the packet unless all of it is there.
     if (!tlv.unpack(stream)) {
         stream.seek(cur);
         return DemuxStatus::NotEnoughBuffer;
     }
 
-    if (stream.leftBytes() < tlv.getDataLength()) {
-        stream.seek(cur);
-        return DemuxStatus::NotEnoughBuffer;
-    }
-
     statistics.tlvPacketCount++;
 
     Common::ReadStream tlvDataStream(tlv.getData());
@@ -139,23 +139,24 @@ DemuxStatus MmtTlvDemuxer::demux(Common::ReadStream& stream) {
                 if (!casHandler) {
                     return DemuxStatus::WattingForEcm;
                 }
+
+                // Keep scrambled packets in order behind the ones already held.
+                uint64_t ecmSequence = casHandler->getEcmSequence();
+                if (!heldPackets.empty() || !casHandler->isKeyReady(mmtp.extensionHeaderScrambling->encryptionFlag, ecmSequence)) {
+                    holdPacket(ecmSequence);
+                    break;
+                }
+                // The input may be read-only, decrypt a copy of the payload.
+                if (mmtp.getWritablePayload().empty()) {
+                    mmtp.detach();
+                }
                 if (!casHandler->decrypt(mmtp)) {
                     return DemuxStatus::WattingForEcm;
                 }
             }
         }
 
-        Common::ReadStream mmtpPayloadStream(mmtp.payload);
-        switch (mmtp.payloadType) {
-        case PayloadType::Mpu:
-            processMpu(mmtpPayloadStream);
-            break;
-        case PayloadType::ContainsOneOrMoreControlMessage:
-            processSignalingMessages(mmtpPayloadStream);
-            break;
-        default:
-            break;
-        }
+        processMmtpPayload();
         break;
     }
     case TlvPacketType::TransmissionControlSignalPacket:
@@ -178,6 +179,66 @@ DemuxStatus MmtTlvDemuxer::demux(Common::ReadStream& stream) {
     return DemuxStatus::Ok;
 }
 
+void MmtTlvDemuxer::processMmtpPayload() {
+    Common::ReadStream mmtpPayloadStream(mmtp.payload);
+    switch (mmtp.payloadType) {
+    case PayloadType::Mpu:
+        processMpu(mmtpPayloadStream);
+        break;
+    case PayloadType::ContainsOneOrMoreControlMessage:
+        processSignalingMessages(mmtpPayloadStream);
+        break;
+    default:
+        break;
+    }
+}
+
+void MmtTlvDemuxer::holdPacket(uint64_t ecmSequence) {
+    // The input buffer is reused once demux() returns.
+    mmtp.detach();
+    heldPackets.push_back({ std::move(mmtp), ecmSequence });
+    statistics.heldPacketCount++;
+    statistics.maxHeldPackets = std::max<uint64_t>(statistics.maxHeldPackets, heldPackets.size());
+
+    if (heldPackets.size() > kMaxHeldPackets) {
+        // Apply backpressure rather than growing further or dropping packets.
+        releaseHeldPackets(true);
+    }
+}
+
+void MmtTlvDemuxer::releaseHeldPackets(bool wait) {
+    while (!heldPackets.empty()) {
+        HeldPacket& held = heldPackets.front();
+        auto keyType = held.mmtp.extensionHeaderScrambling->encryptionFlag;
+        if (!casHandler->isKeyReady(keyType, held.ecmSequence)) {
+            if (!wait) {
+                return;
+            }
+            if (!casHandler->waitForKey(keyType, held.ecmSequence, kKeyTimeout)) {
+                // The key is not coming, none of the held packets can be decrypted.
+                statistics.heldPacketDropCount += heldPackets.size();
+                heldPackets.clear();
+                return;
+            }
+        }
+
+        mmtp = std::move(held.mmtp);
+        heldPackets.pop_front();
+
+        if (!casHandler->decrypt(mmtp)) {
+            statistics.heldPacketDropCount++;
+            continue;
+        }
+        processMmtpPayload();
+    }
+}
+
+void MmtTlvDemuxer::flushHeldPackets() {
+    if (!heldPackets.empty()) {
+        releaseHeldPackets(true);
+    }
+}
+
 void MmtTlvDemuxer::processPaMessage(Common::ReadStream& stream) {
     PaMessage message;
     if (!message.unpack(stream)) {
@@ -637,6 +698,7 @@ void MmtTlvDemuxer::processEcm(const Ecm& ecm) {
 }
 
 void MmtTlvDemuxer::clear() {
+    heldPackets.clear();
     mapAssembler.clear();
     mapFragmentValidator.clear();
     mfuData.clear();
@@ -790,9 +852,7 @@ void MmtTlvDemuxer::processMfuData(Common::ReadStream& stream) {
         return;
     }
 
-    std::vector<uint8_t> data(stream.leftBytes());
-    stream.read(data.data(), stream.leftBytes());
-
+    auto data = stream.getSpan(stream.leftBytes());
     const auto ret = mmtStream->mpuProcessor->process(*mmtStream, data);
     if (ret) {
         const auto& mfuData = ret.value();
@@ -1,5 +1,6 @@
 #pragma once
 #include <vector>
+#include <deque>
 #include <map>
 #include <list>
 #include "stream.h"
@@ -49,9 +50,26 @@ public:
 	DemuxStatus demux(Common::ReadStream& stream);
 	void clear();
 	void printStatistics() const;
+	bool isValidTlv(Common::ReadStream& stream) const;
+
+	CasHandler* getCasHandler() const { return casHandler.get(); }
+	// Whether scrambled packets are waiting for their key.
+	bool hasHeldPackets() const { return !heldPackets.empty(); }
+	// Waits for the keys of the packets still held and processes them.
+	// Called at the end of the input.
+	void flushHeldPackets();
 
 private:
-	bool isValidTlv(Common::ReadStream& stream) const;
+	// A scrambled packet that arrived before its key, tagged with the ECM
+	// that was the latest one at the time.
+	struct HeldPacket {
+		Mmtp mmtp;
+		uint64_t ecmSequence;
+	};
+
+	void holdPacket(uint64_t ecmSequence);
+	void releaseHeldPackets(bool wait);
+	void processMmtpPayload();
 	void processMpu(Common::ReadStream& stream);
 	void processMfuData(Common::ReadStream& stream);
 	void processSignalingMessages(Common::ReadStream& stream);
@@ -88,6 +106,13 @@ private:
 	DataUnit dataUnit;
 	std::map<uint16_t, std::vector<uint8_t>> mfuData;
 	std::unique_ptr<CasHandler> casHandler;
+
+	// Scrambled packets waiting for their key, in stream order. Unscrambled
+	// packets and SI, including the ECMs that carry the keys, pass them.
+	// Bounded by kMaxHeldPackets, beyond which the demuxer waits for the key.
+	static constexpr size_t kMaxHeldPackets = 8192;
+	static constexpr std::chrono::milliseconds kKeyTimeout{10000};
+	std::deque<HeldPacket> heldPackets;
 	DemuxerHandler* demuxerHandler = nullptr;
 	MmtTlvStatistics statistics;
 
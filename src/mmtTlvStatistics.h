@@ -14,6 +14,9 @@ public:
 	uint64_t tlvTransmissionControlSignalPacketCount{0};
 	uint64_t tlvNullPacketCount{0};
 	uint64_t tlvUndefinedCount{0};
+	uint64_t heldPacketCount{0};
+	uint64_t heldPacketDropCount{0};
+	uint64_t maxHeldPackets{0};
 
 	class MmtStat {
 	public:
@@ -203,6 +206,13 @@ public:
 		for (const auto& mmtStat : mapMmtStat) {
 			mmtStat.second->print();
 		}
+
+		if (heldPacketCount > 0) {
+			std::cerr << "Held for key:" << std::endl;
+			std::cerr << " - Count: " << std::to_string(heldPacketCount) << std::endl;
+			std::cerr << " - Max queued: " << std::to_string(maxHeldPackets) << std::endl;
+			std::cerr << " - Dropped: " << std::to_string(heldPacketDropCount) << std::endl;
+		}
 	}
 };
 
@@ -4,68 +4,83 @@
 namespace MmtTlv {
 
 bool Mmtp::unpack(Common::ReadStream& stream) {
-	try {
-		uint8_t uint8 = stream.get8U();
-		version = (uint8 & 0b11000000) >> 6;
-		packetCounterFlag = (uint8 & 0b00100000) >> 5;
-		fecType = (uint8 & 0b00011000) >> 3;
-		reserved1 = (uint8 & 0b00000100) >> 2;
-		extensionHeaderFlag = (uint8 & 0b00000010) >> 1;
-		rapFlag = uint8 & 0b00000001;
+	auto header = stream.getHeader(12);
+	if (!header) {
+		return false;
+	}
 
-		uint8 = stream.get8U();
-		reserved2 = (uint8 & 0b11000000) >> 6;
-		payloadType = static_cast<PayloadType>(uint8 & 0b00111111);
+	uint8_t uint8 = header->get8U();
+	version = (uint8 & 0b11000000) >> 6;
+	packetCounterFlag = (uint8 & 0b00100000) >> 5;
+	fecType = (uint8 & 0b00011000) >> 3;
+	reserved1 = (uint8 & 0b00000100) >> 2;
+	extensionHeaderFlag = (uint8 & 0b00000010) >> 1;
+	rapFlag = uint8 & 0b00000001;
 
-		packetId = stream.getBe16U();
-		deliveryTimestamp = stream.getBe32U();
-		packetSequenceNumber = stream.getBe32U();
+	uint8 = header->get8U();
+	reserved2 = (uint8 & 0b11000000) >> 6;
+	payloadType = static_cast<PayloadType>(uint8 & 0b00111111);
 
-		if (packetCounterFlag) {
-			if (stream.leftBytes() < 4) {
-				return false;
-			}
-			packetCounter = stream.getBe32U();
+	packetId = header->getBe16U();
+	deliveryTimestamp = header->getBe32U();
+	packetSequenceNumber = header->getBe32U();
+
+	if (packetCounterFlag) {
+		auto counter = stream.getHeader(4);
+		if (!counter) {
+			return false;
 		}
+		packetCounter = counter->getBe32U();
+	}
 
-		if (extensionHeaderFlag) {
-			if (stream.leftBytes() < 4) {
-				return false;
-			}
-			extensionHeaderType = stream.getBe16U();
-			extensionHeaderLength = stream.getBe16U();
+	if (extensionHeaderFlag) {
+		auto extension = stream.getHeader(4);
+		if (!extension) {
+			return false;
+		}
+		extensionHeaderType = extension->getBe16U();
+		extensionHeaderLength = extension->getBe16U();
 
-			if (stream.leftBytes() < extensionHeaderLength) {
-				return false;
-			}
-			extensionHeaderField.resize(extensionHeaderLength);
-			stream.read(extensionHeaderField.data(), extensionHeaderLength);
+		if (stream.leftBytes() < extensionHeaderLength) {
+			return false;
+		}
+		extensionHeaderField = stream.getSpan(extensionHeaderLength);
 
-			if (extensionHeaderField.size() >= 5) {
-				uint16_t e = Common::swapEndian16(*(uint16_t*)extensionHeaderField.data());
-				if ((e & 0x7FFF) == 0x0001) {
-					Common::ReadStream nstream(extensionHeaderField);
-					nstream.skip(4);
+		if (extensionHeaderField.size() >= 5) {
+			uint16_t e = Common::swapEndian16(*(const uint16_t*)extensionHeaderField.data());
+			if ((e & 0x7FFF) == 0x0001) {
+				Common::ReadStream nstream(extensionHeaderField);
+				nstream.skip(4);
 
-					ExtensionHeaderScrambling s;
-					if (s.unpack(nstream, extensionHeaderType, extensionHeaderLength)) {
-						extensionHeaderScrambling = s;
-					}
+				ExtensionHeaderScrambling s;
+				if (s.unpack(nstream, extensionHeaderType, extensionHeaderLength)) {
+					extensionHeaderScrambling = s;
 				}
 			}
 		}
-		else {
-			extensionHeaderScrambling = std::nullopt;
-		}
-
-		payload.resize(stream.leftBytes());
-		stream.read(payload.data(), stream.leftBytes());
 	}
-	catch (const std::out_of_range&) {
-		return false;
+	else {
+		extensionHeaderScrambling = std::nullopt;
 	}
 
+	payload = stream.getSpan(stream.leftBytes());
+	writablePayload = {};
 	return true;
 }
 
+void Mmtp::detach() {
+	if (!payloadStorage.empty() && payload.data() == payloadStorage.data()) {
+		return;
+	}
+
+	payloadStorage.assign(payload.begin(), payload.end());
+	payload = payloadStorage;
+	writablePayload = payloadStorage;
+}
+
+void Mmtp::setWritablePayload(std::span<uint8_t> data) {
+	payload = data;
+	writablePayload = data;
+}
+
 }
\ No newline at end of file
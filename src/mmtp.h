@@ -1,6 +1,8 @@
 #pragma once
 #include <cstdint>
 #include <optional>
+#include <span>
+#include <vector>
 #include "stream.h"
 #include "extensionHeaderScrambling.h"
 
@@ -32,8 +34,28 @@ constexpr uint16_t MhSit = 0x8009;
 
 class Mmtp {
 public:
+	Mmtp() = default;
+
+	// The payload may point into the packet's own storage, which a copy would
+	// not follow.
+	Mmtp(const Mmtp&) = delete;
+	Mmtp& operator=(const Mmtp&) = delete;
+
+	Mmtp(Mmtp&&) = default;
+	Mmtp& operator=(Mmtp&&) = default;
+
 	bool unpack(Common::ReadStream& stream);
 
+	// Copies the payload into storage owned by the packet, so that it stays
+	// valid once the buffer it was unpacked from is reused, and can be
+	// decrypted in place.
+	void detach();
+	// Points the payload at writable memory holding the same bytes, such as a
+	// copy of the whole packet, so that it can be decrypted in place there.
+	void setWritablePayload(std::span<uint8_t> data);
+	// The payload if it is writable, empty otherwise.
+	std::span<uint8_t> getWritablePayload() const { return writablePayload; }
+
 public:
 	uint8_t version;
 	bool packetCounterFlag;
@@ -49,11 +71,17 @@ public:
 	uint32_t packetCounter;
 	uint16_t extensionHeaderType;
 	uint16_t extensionHeaderLength;
-	std::vector<uint8_t> extensionHeaderField;
-	std::vector<uint8_t> payload;
+	// Views into the buffer the packet was unpacked from, the payload may be
+	// moved elsewhere by detach() or setWritablePayload().
+	std::span<const uint8_t> extensionHeaderField;
+	std::span<const uint8_t> payload;
 
 	std::optional<ExtensionHeaderScrambling> extensionHeaderScrambling;
 
+private:
+	std::span<uint8_t> writablePayload;
+	std::vector<uint8_t> payloadStorage;
+
 };
 
 }
\ No newline at end of file
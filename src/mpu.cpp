@@ -4,28 +4,30 @@ namespace MmtTlv {
 
 bool Mpu::unpack(Common::ReadStream& stream)
 {
-	try {
-		payloadLength = stream.getBe16U();
-		if (payloadLength != stream.leftBytes())
-			return false;
-
-		uint8_t byte = stream.get8U();
-		fragmentType = static_cast<FragmentType>(byte >> 4);
-		timedFlag = (byte >> 3) & 1;
-		fragmentationIndicator = static_cast<FragmentationIndicator>((byte >> 1) & 0b11);
-		aggregateFlag = byte & 1;
-
-		fragmentCounter = stream.get8U();
-		mpuSequenceNumber = stream.getBe32U();
+	auto length = stream.getHeader(2);
+	if (!length) {
+		return false;
+	}
 
-		payload.resize(payloadLength - 6);
-		stream.read(payload.data(), payloadLength - 6);
+	payloadLength = length->getBe16U();
+	if (payloadLength != stream.leftBytes())
+		return false;
 
-	}
-	catch (const std::out_of_range&) {
+	auto header = stream.getHeader(6);
+	if (!header) {
 		return false;
 	}
 
+	uint8_t byte = header->get8U();
+	fragmentType = static_cast<FragmentType>(byte >> 4);
+	timedFlag = (byte >> 3) & 1;
+	fragmentationIndicator = static_cast<FragmentationIndicator>((byte >> 1) & 0b11);
+	aggregateFlag = byte & 1;
+
+	fragmentCounter = header->get8U();
+	mpuSequenceNumber = header->getBe32U();
+
+	payload = stream.getSpan(payloadLength - 6);
 	return true;
 }
 
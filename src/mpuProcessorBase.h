@@ -1,4 +1,5 @@
 #pragma once
+#include <span>
 #include <vector>
 #include <optional>
 #include <memory>
@@ -36,7 +37,7 @@ class MmtStream;
 class MpuProcessorBase {
 public:
 	virtual ~MpuProcessorBase() = default;
-	virtual std::optional<MfuData> process(MmtStream& mmtStream, const std::vector<uint8_t>& data) { return std::nullopt; }
+	virtual std::optional<MfuData> process(MmtStream& mmtStream, std::span<const uint8_t> data) { return std::nullopt; }
 	virtual void clear() {}
 
 };
@@ -3,13 +3,18 @@
 
 namespace MmtTlv {
 
-std::optional<MfuData> MpuSubtitleProcessor::process(MmtStream& mmtStream, const std::vector<uint8_t>& data) {
+std::optional<MfuData> MpuSubtitleProcessor::process(MmtStream& mmtStream, std::span<const uint8_t> data) {
     Common::ReadStream stream(data);
 
-    uint16_t subsampleNumber = stream.getBe16U();
-    uint16_t lastSubsampleNumber = stream.getBe16U();
+    auto header = stream.getHeader(5);
+    if (!header) {
+        return std::nullopt;
+    }
+
+    uint16_t subsampleNumber = header->getBe16U();
+    uint16_t lastSubsampleNumber = header->getBe16U();
 
-    uint8_t uint8 = stream.get8U();
+    uint8_t uint8 = header->get8U();
     uint8_t dataType = uint8 >> 4;
     uint8_t lengthExtFlag = (uint8 >> 3) & 1;
     uint8_t subsampleInfoListFlag = (uint8 >> 2) & 1;
@@ -18,23 +23,24 @@ std::optional<MfuData> MpuSubtitleProcessor::process(MmtStream& mmtStream, const
         return std::nullopt;
     }
 
+    auto size = stream.getHeader(lengthExtFlag ? 4 : 2);
+    if (!size) {
+        return std::nullopt;
+    }
+
     uint32_t dataSize;
     if (lengthExtFlag)
-        dataSize = stream.getBe32U();
+        dataSize = size->getBe32U();
     else
-        dataSize = stream.getBe16U();
+        dataSize = size->getBe16U();
 
     if (subsampleNumber == 0 && lastSubsampleNumber > 0 && subsampleInfoListFlag) {
-        for (int i = 0; i < lastSubsampleNumber; ++i) {
-            stream.skip(4 + 4); // subsample_i_data_type
-
-            if (lengthExtFlag) {
-                stream.skip(4); // subsample_i_data_size
-            }
-            else {
-                stream.skip(2); // subsample_i_data_size
-            }
+        // subsample_i_data_type and subsample_i_data_size
+        size_t subsampleInfoSize = (4 + 4 + (lengthExtFlag ? 4 : 2)) * static_cast<size_t>(lastSubsampleNumber);
+        if (stream.leftBytes() < subsampleInfoSize) {
+            return std::nullopt;
         }
+        stream.skip(subsampleInfoSize);
     }
 
     if (stream.leftBytes() < dataSize) {
@@ -8,7 +8,7 @@ namespace MmtTlv {
 constexpr uint8_t CRA_NUT = 0x15;
 constexpr uint8_t NAL_AUD = 0x23;
 
-std::optional<MfuData> MpuVideoProcessor::process(MmtStream& mmtStream, const std::vector<uint8_t>& data) {
+std::optional<MfuData> MpuVideoProcessor::process(MmtStream& mmtStream, std::span<const uint8_t> data) {
     Common::ReadStream stream(data);
     MfuData mfuData;
 
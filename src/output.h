@@ -0,0 +1,87 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <span>
+#include <vector>
+
+constexpr size_t kTsPacketSize = 188;
+
+// Destination of the remuxed TS stream.
+// Besides write(), producers can build data in place: reserve() returns a
+// writable region of the requested size inside the output buffer, and
+// commit() appends the first size bytes of it to the output. The region stays
+// valid until the next call on the output.
+class IOutput {
+public:
+    virtual ~IOutput() = default;
+    virtual void write(const uint8_t* data, size_t size) = 0;
+    virtual std::span<uint8_t> reserve(size_t size) = 0;
+    virtual void commit(size_t size) = 0;
+    virtual void flush() = 0;
+    // True once a write has failed. The output after the failure is dropped.
+    virtual bool hasFailed() const { return false; }
+};
+
+// Appends the output to a vector, e.g. the BonDriver's remux buffer.
+class VectorOutput : public IOutput {
+public:
+    explicit VectorOutput(std::vector<uint8_t>& buffer)
+        : buffer(buffer) {
+    }
+
+    void write(const uint8_t* data, size_t size) override {
+        buffer.insert(buffer.end(), data, data + size);
+    }
+
+    std::span<uint8_t> reserve(size_t size) override {
+        reservedOffset = buffer.size();
+        buffer.resize(reservedOffset + size);
+        return { buffer.data() + reservedOffset, size };
+    }
+
+    void commit(size_t size) override {
+        buffer.resize(reservedOffset + size);
+    }
+
+    void flush() override {}
+
+private:
+    std::vector<uint8_t>& buffer;
+    size_t reservedOffset{0};
+};
+
+// Adapter for callers that consume the stream one TS packet at a time.
+class CallbackOutput : public IOutput {
+public:
+    using Callback = std::function<void(const uint8_t*, size_t)>;
+
+    explicit CallbackOutput(Callback callback)
+        : callback(std::move(callback)) {
+    }
+
+    void write(const uint8_t* data, size_t size) override {
+        while (size > 0) {
+            size_t length = std::min(size, kTsPacketSize);
+            callback(data, length);
+            data += length;
+            size -= length;
+        }
+    }
+
+    std::span<uint8_t> reserve(size_t size) override {
+        scratch.resize(size);
+        return scratch;
+    }
+
+    void commit(size_t size) override {
+        write(scratch.data(), size);
+    }
+
+    void flush() override {}
+
+private:
+    Callback callback;
+    std::vector<uint8_t> scratch;
+};
@@ -0,0 +1,420 @@
+#include "parserBenchmark.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <span>
+#include <vector>
+#include "compressedIPPacket.h"
+#include "dataUnit.h"
+#include "mmtp.h"
+#include "mpu.h"
+#include "stream.h"
+
+namespace {
+
+// Small enough to stay in the cache, as a packet does between framing and
+// parsing, so that the parsers rather than memory are measured.
+constexpr size_t kPacketCount = 2000;
+constexpr size_t kRounds = 1000;
+// Header bytes a damaged packet is cut or overwritten within: the compressed
+// IP header, the MMTP header with its scrambling extension, the MPU header
+// and the data unit header.
+constexpr size_t kHeaderSize = 3 + 12 + 4 + 5 + 8 + 14;
+
+// The fields both parsers agree on.
+struct Headers {
+    uint16_t packetId{0};
+    uint32_t packetSequenceNumber{0};
+    uint32_t mpuSequenceNumber{0};
+    uint32_t sampleNumber{0};
+    uint32_t itemId{0};
+    const uint8_t* data{nullptr};
+    size_t dataSize{0};
+
+    bool operator==(const Headers&) const = default;
+};
+
+// A header compressed IP packet carrying a scrambled, timed MFU, the contents
+// of a TLV packet as the demuxer sees it.
+std::vector<uint8_t> makePacket(std::mt19937& random, uint32_t sequenceNumber) {
+    std::vector<uint8_t> packet = {
+        // Compressed IP header, no IPv6/UDP header
+        0x00, 0x10, static_cast<uint8_t>(MmtTlv::ContextHeaderType::ContextIdNoCompressedHheader),
+        // MMTP header with an extension header
+        0x02, static_cast<uint8_t>(MmtTlv::PayloadType::Mpu), 0x01, 0x00, 0x00, 0x00, 0x00, 0x00,
+        static_cast<uint8_t>(sequenceNumber >> 24), static_cast<uint8_t>(sequenceNumber >> 16),
+        static_cast<uint8_t>(sequenceNumber >> 8), static_cast<uint8_t>(sequenceNumber),
+        // Scrambling extension
+        0x00, 0x00, 0x00, 0x05, 0x80, 0x01, 0x00, 0x01, 0x18,
+    };
+
+    size_t dataSize = 64 + random() % 1300;
+    size_t mpuLength = 6 + 14 + dataSize;
+    packet.insert(packet.end(), {
+        static_cast<uint8_t>(mpuLength >> 8), static_cast<uint8_t>(mpuLength),
+        // MFU, timed, middle fragment, not aggregated
+        0x2C, 0x00, 0x00, 0x00, 0x00, static_cast<uint8_t>(sequenceNumber >> 8),
+        // Data unit header
+        0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, static_cast<uint8_t>(sequenceNumber),
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    });
+
+    for (size_t i = 0; i < dataSize; ++i) {
+        packet.push_back(static_cast<uint8_t>(random()));
+    }
+    return packet;
+}
+
+// Damages two of three packets the way bit errors in the TLV header and in
+// the payload would: cut short within the headers, or with header bytes
+// overwritten.
+void damage(std::mt19937& random, std::vector<uint8_t>& packet) {
+    switch (random() % 3) {
+    case 0:
+        break;
+    case 1:
+        packet.resize(random() % kHeaderSize);
+        break;
+    case 2:
+        for (int i = 0; i < 4; ++i) {
+            packet[random() % kHeaderSize] = static_cast<uint8_t>(random());
+        }
+        break;
+    }
+}
+
+struct Parsers {
+    MmtTlv::CompressedIPPacket compressedIPPacket;
+    MmtTlv::Mmtp mmtp;
+    MmtTlv::Mpu mpu;
+    MmtTlv::DataUnit dataUnit;
+};
+
+// The parsers as they were before they validated the length of each header
+// once: every field is read with the checked ReadStream accessors, and a read
+// past the end throws std::out_of_range, which each parser catches.
+namespace checked {
+
+bool unpack(MmtTlv::CompressedIPPacket& packet, MmtTlv::Common::ReadStream& stream) {
+    try {
+        uint16_t uint16 = stream.getBe16U();
+        packet.contextId = (uint16 & 0b1111111111110000) >> 4;
+        packet.sequenceNumber = uint16 & 0b0000000000001111;
+        packet.headerType = static_cast<MmtTlv::ContextHeaderType>(stream.get8U());
+
+        if (packet.headerType == MmtTlv::ContextHeaderType::ContextIdPartialIpv6AndPartialUdp) {
+            packet.ipv6 = stream.getSpan(38);
+            packet.udp = stream.getSpan(4);
+        }
+    }
+    catch (const std::out_of_range&) {
+        return false;
+    }
+
+    return true;
+}
+
+bool unpack(MmtTlv::ExtensionHeaderScrambling& scrambling, MmtTlv::Common::ReadStream& stream) {
+    try {
+        if (stream.leftBytes() < 1) {
+            return false;
+        }
+
+        uint8_t uint8 = stream.get8U();
+        scrambling.encryptionFlag = static_cast<MmtTlv::EncryptionFlag>((uint8 & 0b00011000) >> 3);
+        scrambling.scramblingSubsystem = (uint8 & 0b00000100) >> 2;
+        scrambling.messageAuthenticationControl = (uint8 & 0b00000010) >> 1;
+        scrambling.scramblingInitialCounterValue = uint8 & 0b00000001;
+    }
+    catch (const std::out_of_range&) {
+        return false;
+    }
+
+    return true;
+}
+
+bool unpack(MmtTlv::Mmtp& mmtp, MmtTlv::Common::ReadStream& stream) {
+    try {
+        uint8_t uint8 = stream.get8U();
+        mmtp.version = (uint8 & 0b11000000) >> 6;
+        mmtp.packetCounterFlag = (uint8 & 0b00100000) >> 5;
+        mmtp.fecType = (uint8 & 0b00011000) >> 3;
+        mmtp.reserved1 = (uint8 & 0b00000100) >> 2;
+        mmtp.extensionHeaderFlag = (uint8 & 0b00000010) >> 1;
+        mmtp.rapFlag = uint8 & 0b00000001;
+
+        uint8 = stream.get8U();
+        mmtp.reserved2 = (uint8 & 0b11000000) >> 6;
+        mmtp.payloadType = static_cast<MmtTlv::PayloadType>(uint8 & 0b00111111);
+
+        mmtp.packetId = stream.getBe16U();
+        mmtp.deliveryTimestamp = stream.getBe32U();
+        mmtp.packetSequenceNumber = stream.getBe32U();
+
+        if (mmtp.packetCounterFlag) {
+            if (stream.leftBytes() < 4) {
+                return false;
+            }
+            mmtp.packetCounter = stream.getBe32U();
+        }
+
+        if (mmtp.extensionHeaderFlag) {
+            if (stream.leftBytes() < 4) {
+                return false;
+            }
+            mmtp.extensionHeaderType = stream.getBe16U();
+            mmtp.extensionHeaderLength = stream.getBe16U();
+
+            if (stream.leftBytes() < mmtp.extensionHeaderLength) {
+                return false;
+            }
+            mmtp.extensionHeaderField = stream.getSpan(mmtp.extensionHeaderLength);
+
+            if (mmtp.extensionHeaderField.size() >= 5) {
+                uint16_t e = MmtTlv::Common::swapEndian16(*(const uint16_t*)mmtp.extensionHeaderField.data());
+                if ((e & 0x7FFF) == 0x0001) {
+                    MmtTlv::Common::ReadStream nstream(mmtp.extensionHeaderField);
+                    nstream.skip(4);
+
+                    MmtTlv::ExtensionHeaderScrambling s;
+                    if (unpack(s, nstream)) {
+                        mmtp.extensionHeaderScrambling = s;
+                    }
+                }
+            }
+        }
+        else {
+            mmtp.extensionHeaderScrambling = std::nullopt;
+        }
+
+        mmtp.payload = stream.getSpan(stream.leftBytes());
+    }
+    catch (const std::out_of_range&) {
+        return false;
+    }
+
+    return true;
+}
+
+bool unpack(MmtTlv::Mpu& mpu, MmtTlv::Common::ReadStream& stream) {
+    try {
+        mpu.payloadLength = stream.getBe16U();
+        if (mpu.payloadLength != stream.leftBytes())
+            return false;
+
+        uint8_t byte = stream.get8U();
+        mpu.fragmentType = static_cast<MmtTlv::FragmentType>(byte >> 4);
+        mpu.timedFlag = (byte >> 3) & 1;
+        mpu.fragmentationIndicator = static_cast<MmtTlv::FragmentationIndicator>((byte >> 1) & 0b11);
+        mpu.aggregateFlag = byte & 1;
+
+        mpu.fragmentCounter = stream.get8U();
+        mpu.mpuSequenceNumber = stream.getBe32U();
+
+        mpu.payload = stream.getSpan(mpu.payloadLength - 6);
+    }
+    catch (const std::out_of_range&) {
+        return false;
+    }
+
+    return true;
+}
+
+bool unpack(MmtTlv::DataUnit& dataUnit, MmtTlv::Common::ReadStream& stream, bool timedFlag, bool aggregateFlag) {
+    try {
+        if (timedFlag) {
+            if (aggregateFlag == 0) {
+                dataUnit.movieFragmentSequenceNumber = stream.getBe32U();
+                dataUnit.sampleNumber = stream.getBe32U();
+                dataUnit.offset = stream.getBe32U();
+                dataUnit.priority = stream.get8U();
+                dataUnit.dependencyCounter = stream.get8U();
+
+                dataUnit.data = stream.getSpan(stream.leftBytes());
+            }
+            else {
+                dataUnit.dataUnitLength = stream.getBe16U();
+                dataUnit.dataUnitLength = std::min(dataUnit.dataUnitLength, static_cast<uint16_t>(stream.leftBytes()));
+
+                dataUnit.movieFragmentSequenceNumber = stream.getBe32U();
+                dataUnit.sampleNumber = stream.getBe32U();
+                dataUnit.offset = stream.getBe32U();
+                dataUnit.priority = stream.get8U();
+                dataUnit.dependencyCounter = stream.get8U();
+
+                if (dataUnit.dataUnitLength < 4 * 3 + 2) {
+                    return false;
+                }
+
+                dataUnit.data = stream.getSpan(dataUnit.dataUnitLength - 4 * 3 - 2);
+            }
+        }
+        else {
+            if (aggregateFlag == 0) {
+                dataUnit.itemId = stream.getBe32U();
+
+                dataUnit.data = stream.getSpan(stream.leftBytes());
+            }
+            else {
+                dataUnit.dataUnitLength = stream.getBe16U();
+
+                dataUnit.data = stream.getSpan(dataUnit.dataUnitLength);
+            }
+        }
+    }
+    catch (const std::out_of_range&) {
+        return false;
+    }
+
+    return true;
+}
+
+}
+
+void collect(const Parsers& parsers, Headers& headers) {
+    headers.packetId = parsers.mmtp.packetId;
+    headers.packetSequenceNumber = parsers.mmtp.packetSequenceNumber;
+    headers.mpuSequenceNumber = parsers.mpu.mpuSequenceNumber;
+    if (parsers.mpu.timedFlag) {
+        headers.sampleNumber = parsers.dataUnit.sampleNumber;
+    }
+    else if (!parsers.mpu.aggregateFlag) {
+        headers.itemId = parsers.dataUnit.itemId;
+    }
+    headers.data = parsers.dataUnit.data.data();
+    headers.dataSize = parsers.dataUnit.data.size();
+}
+
+bool parseChecked(std::span<const uint8_t> packet, Parsers& parsers, Headers& headers) {
+    MmtTlv::Common::ReadStream stream(packet);
+    if (!checked::unpack(parsers.compressedIPPacket, stream) || !checked::unpack(parsers.mmtp, stream) ||
+        parsers.mmtp.payloadType != MmtTlv::PayloadType::Mpu) {
+        return false;
+    }
+
+    MmtTlv::Common::ReadStream payloadStream(parsers.mmtp.payload);
+    if (!checked::unpack(parsers.mpu, payloadStream)) {
+        return false;
+    }
+
+    MmtTlv::Common::ReadStream mpuStream(parsers.mpu.payload);
+    if (!checked::unpack(parsers.dataUnit, mpuStream, parsers.mpu.timedFlag, parsers.mpu.aggregateFlag)) {
+        return false;
+    }
+
+    collect(parsers, headers);
+    return true;
+}
+
+bool parseFast(std::span<const uint8_t> packet, Parsers& parsers, Headers& headers) {
+    MmtTlv::Common::ReadStream stream(packet);
+    if (!parsers.compressedIPPacket.unpack(stream) || !parsers.mmtp.unpack(stream) ||
+        parsers.mmtp.payloadType != MmtTlv::PayloadType::Mpu) {
+        return false;
+    }
+
+    MmtTlv::Common::ReadStream payloadStream(parsers.mmtp.payload);
+    if (!parsers.mpu.unpack(payloadStream)) {
+        return false;
+    }
+
+    MmtTlv::Common::ReadStream mpuStream(parsers.mpu.payload);
+    if (!parsers.dataUnit.unpack(mpuStream, parsers.mpu.timedFlag, parsers.mpu.aggregateFlag)) {
+        return false;
+    }
+
+    collect(parsers, headers);
+    return true;
+}
+
+// Returns the number of packets both parsers accept, or SIZE_MAX if they
+// disagree on one.
+size_t verify(const std::vector<std::vector<uint8_t>>& packets) {
+    Parsers checkedParsers;
+    Parsers parsers;
+    size_t parsed = 0;
+    for (const auto& packet : packets) {
+        Headers checked;
+        Headers fast;
+        bool checkedOk = parseChecked(packet, checkedParsers, checked);
+        bool fastOk = parseFast(packet, parsers, fast);
+        if (checkedOk != fastOk || (checkedOk && !(checked == fast))) {
+            return SIZE_MAX;
+        }
+        parsed += checkedOk;
+    }
+    return parsed;
+}
+
+template<typename Function>
+void measure(const char* name, size_t packetCount, Function function) {
+    auto start = std::chrono::steady_clock::now();
+    function();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::cerr << "   - " << name << ": " << std::fixed << std::setprecision(1)
+        << seconds * 1e9 / packetCount << " ns/packet" << std::endl;
+}
+
+bool benchmarkCorpus(const char* name, const std::vector<std::vector<uint8_t>>& packets) {
+    std::cerr << " - " << name << ": ";
+    size_t parsed = verify(packets);
+    if (parsed == SIZE_MAX) {
+        std::cerr << "FAILED" << std::endl;
+        return false;
+    }
+    std::cerr << "verified, " << packets.size() - parsed << " of " << packets.size() << " packets rejected" << std::endl;
+
+    // Keeps the parsers from being optimized away.
+    size_t dataBytes = 0;
+    Parsers parsers;
+    measure("Checked", kRounds * packets.size(), [&]() {
+        for (size_t round = 0; round < kRounds; ++round) {
+            for (const auto& packet : packets) {
+                Headers headers;
+                if (parseChecked(packet, parsers, headers)) {
+                    dataBytes += headers.dataSize;
+                }
+            }
+        }
+    });
+
+    measure("Header parsers", kRounds * packets.size(), [&]() {
+        for (size_t round = 0; round < kRounds; ++round) {
+            for (const auto& packet : packets) {
+                Headers headers;
+                if (parseFast(packet, parsers, headers)) {
+                    dataBytes += headers.dataSize;
+                }
+            }
+        }
+    });
+
+    volatile size_t sink = dataBytes;
+    (void)sink;
+    return true;
+}
+
+}
+
+bool runParserBenchmark() {
+    std::mt19937 random(2160);
+    std::vector<std::vector<uint8_t>> intact;
+    intact.reserve(kPacketCount);
+    for (size_t i = 0; i < kPacketCount; ++i) {
+        intact.push_back(makePacket(random, static_cast<uint32_t>(i)));
+    }
+
+    std::vector<std::vector<uint8_t>> damaged = intact;
+    for (auto& packet : damaged) {
+        damage(random, packet);
+    }
+
+    std::cerr << "Header parsers:" << std::endl;
+    bool ok = benchmarkCorpus("Intact", intact);
+    ok = benchmarkCorpus("Damaged", damaged) && ok;
+    return ok;
+}
@@ -0,0 +1,7 @@
+#pragma once
+
+// Parses a synthetic corpus of MPU packets, intact and with damaged headers,
+// with the header parsers and with a reference that decodes the same headers
+// through the checked, throwing ReadStream accessors. Prints the time per
+// packet of both. Returns false if they disagree on any packet.
+bool runParserBenchmark();
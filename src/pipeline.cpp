@@ -0,0 +1,370 @@
+#include "pipeline.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include "compressedIPPacket.h"
+#include "inputSource.h"
+#include "mmtp.h"
+#include "mmtTlvDemuxer.h"
+#include "progressReporter.h"
+#include "stream.h"
+#include "threadPool.h"
+
+namespace {
+
+constexpr size_t kTlvHeaderSize = 4;
+constexpr size_t kMmtpHeaderSize = 12;
+// How long a key change waits for the smart card.
+constexpr std::chrono::milliseconds kKeyTimeout{10000};
+
+// A scrambled MMTP packet found by the framing stage.
+struct ScrambledPacket {
+    MmtTlv::Mmtp mmtp;
+    // Offsets from the start of the TLV packet.
+    size_t flagOffset{0};
+    size_t payloadOffset{0};
+};
+
+// Parses a header compressed IP packet far enough to tell whether its MMTP
+// payload is scrambled.
+bool parseScrambledPacket(std::span<const uint8_t> packet, ScrambledPacket& scrambled) {
+    if (packet[1] != static_cast<uint8_t>(MmtTlv::TlvPacketType::HeaderCompressedIpPacket)) {
+        return false;
+    }
+
+    MmtTlv::Common::ReadStream stream(packet.subspan(kTlvHeaderSize));
+    MmtTlv::CompressedIPPacket compressedIPPacket;
+    if (!compressedIPPacket.unpack(stream)) {
+        return false;
+    }
+
+    size_t mmtpOffset = kTlvHeaderSize + stream.getPos();
+    if (!scrambled.mmtp.unpack(stream) || !scrambled.mmtp.extensionHeaderScrambling) {
+        return false;
+    }
+
+    auto keyType = scrambled.mmtp.extensionHeaderScrambling->encryptionFlag;
+    if (keyType != MmtTlv::EncryptionFlag::ODD && keyType != MmtTlv::EncryptionFlag::EVEN) {
+        return false;
+    }
+
+    // The scrambling control byte follows the extension header type, its
+    // length and the 4-byte header of the scrambling extension.
+    scrambled.flagOffset = mmtpOffset + kMmtpHeaderSize + (scrambled.mmtp.packetCounterFlag ? 4 : 0) + 4 + 4;
+    scrambled.payloadOffset = packet.size() - scrambled.mmtp.payload.size();
+    return true;
+}
+
+}
+
+PipelinedOutput::PipelinedOutput(IOutput& output)
+    : output(output) {
+    for (size_t i = 0; i < kBufferCount; ++i) {
+        auto buffer = std::make_unique<Buffer>();
+        buffer->data.resize(kBufferSize);
+        freeQueue.push(buffer.get());
+        buffers.push_back(std::move(buffer));
+    }
+
+    current = freeQueue.pop();
+    writerThread = std::thread(&PipelinedOutput::writer, this);
+}
+
+PipelinedOutput::~PipelinedOutput() {
+    flush();
+    filledQueue.push(nullptr);
+    writerThread.join();
+}
+
+void PipelinedOutput::write(const uint8_t* data, size_t size) {
+    while (size > 0) {
+        size_t length = std::min(size, kBufferSize - current->size);
+        memcpy(current->data.data() + current->size, data, length);
+        current->size += length;
+        data += length;
+        size -= length;
+
+        if (current->size == kBufferSize) {
+            submit();
+        }
+    }
+}
+
+std::span<uint8_t> PipelinedOutput::reserve(size_t size) {
+    if (current->size + size > kBufferSize) {
+        submit();
+    }
+    return { current->data.data() + current->size, size };
+}
+
+void PipelinedOutput::commit(size_t size) {
+    current->size += size;
+}
+
+void PipelinedOutput::flush() {
+    if (current->size > 0) {
+        submit();
+    }
+
+    uint64_t written;
+    while ((written = writtenCount.load(std::memory_order_acquire)) != submittedCount) {
+        writtenCount.wait(written, std::memory_order_acquire);
+    }
+    output.flush();
+}
+
+void PipelinedOutput::submit() {
+    filledQueue.push(current);
+    ++submittedCount;
+    current = freeQueue.pop();
+}
+
+void PipelinedOutput::writer() {
+    while (Buffer* buffer = filledQueue.pop()) {
+        output.write(buffer->data.data(), buffer->size);
+        buffer->size = 0;
+        freeQueue.push(buffer);
+
+        writtenCount.fetch_add(1, std::memory_order_release);
+        writtenCount.notify_one();
+    }
+}
+
+PipelinedDemuxer::PipelinedDemuxer(MmtTlv::MmtTlvDemuxer& demuxer, IInputSource& input, ProgressReporter& progressReporter,
+    ThreadPool* decryptionPool)
+    : demuxer(demuxer), input(input), progressReporter(progressReporter), decryptionPool(decryptionPool) {
+    for (size_t i = 0; i < kBatchCount; ++i) {
+        auto batch = std::make_unique<Batch>();
+        batch->data.resize(kBatchSize);
+        freeQueue.push(batch.get());
+        batches.push_back(std::move(batch));
+    }
+}
+
+PipelinedDemuxer::~PipelinedDemuxer() {
+    if (!framerThread.joinable()) {
+        return;
+    }
+
+    // run() left through an exception. The framing stage may be blocked on a
+    // free batch, a full queue or a drain, so count the batch the demux stage
+    // failed on as processed and keep taking batches until it has stopped.
+    stopRequested.store(true, std::memory_order_relaxed);
+    processedCount.fetch_add(1, std::memory_order_release);
+    processedCount.notify_one();
+    while (Batch* batch = filledQueue.pop()) {
+        batch->size = 0;
+        freeQueue.push(batch);
+
+        processedCount.fetch_add(1, std::memory_order_release);
+        processedCount.notify_one();
+    }
+
+    framerThread.join();
+}
+
+void PipelinedDemuxer::setPositionCallback(std::function<void(uint64_t)> callback) {
+    positionCallback = std::move(callback);
+}
+
+uint64_t PipelinedDemuxer::run() {
+    framerThread = std::thread(&PipelinedDemuxer::framer, this);
+
+    while (Batch* batch = filledQueue.pop()) {
+        MmtTlv::Common::ReadStream stream(std::span<const uint8_t>(batch->data.data(), batch->size));
+        while (!stream.isEof()) {
+            if (demuxer.demux(stream) == MmtTlv::DemuxStatus::NotEnoughBuffer) {
+                break;
+            }
+        }
+
+        batch->size = 0;
+        freeQueue.push(batch);
+
+        processedCount.fetch_add(1, std::memory_order_release);
+        processedCount.notify_one();
+    }
+
+    framerThread.join();
+
+    if (framerError) {
+        std::rethrow_exception(framerError);
+    }
+    demuxer.flushHeldPackets();
+    return inputBytes;
+}
+
+void PipelinedDemuxer::framer() {
+    try {
+        current = freeQueue.pop();
+
+        while (true) {
+            std::span<const uint8_t> inputData = input.next();
+
+            MmtTlv::Common::ReadStream stream(inputData);
+            while (stream.leftBytes() >= kTlvHeaderSize) {
+                if (!demuxer.isValidTlv(stream)) {
+                    stream.skip(1);
+                    continue;
+                }
+
+                uint8_t header[kTlvHeaderSize];
+                stream.peek(header, kTlvHeaderSize);
+                size_t length = kTlvHeaderSize + ((header[2] << 8) | header[3]);
+                if (stream.leftBytes() < length) {
+                    break;
+                }
+
+                addPacket(inputData.subspan(stream.getPos(), length));
+                stream.skip(length);
+            }
+
+            auto consumed = inputData.size() - stream.leftBytes();
+            if (consumed > 0) {
+                progressReporter.update(consumed);
+                inputBytes += consumed;
+                if (positionCallback) {
+                    positionCallback(inputBytes);
+                }
+            }
+            input.consume(consumed);
+
+            // Hand over what this chunk produced, live input should not wait for a full batch.
+            pushBatch();
+
+            if ((consumed == 0 && input.isEof()) || stopRequested.load(std::memory_order_relaxed)) {
+                break;
+            }
+        }
+    }
+    catch (...) {
+        framerError = std::current_exception();
+    }
+
+    if (current && current->size > 0) {
+        if (!framerError) {
+            decryptPending();
+        }
+        filledQueue.push(current);
+    }
+    filledQueue.push(nullptr);
+}
+
+void PipelinedDemuxer::addPacket(std::span<const uint8_t> packet) {
+    ScrambledPacket scrambled;
+    bool scrambledPacket = parseScrambledPacket(packet, scrambled);
+    // Taken before pushBatch() below may end the deferral.
+    bool deferred = deferDecryption;
+    bool keyChanged = false;
+    if (scrambledPacket && !deferred) {
+        auto keyType = scrambled.mmtp.extensionHeaderScrambling->encryptionFlag;
+
+        if (keyType != lastKeyType) {
+            // On a key change the demux stage may not have passed the ECM that
+            // carries the new key to the CAS handler yet. Let it catch up, so the
+            // key is looked up at the same point of the stream as in the serial path.
+            pushBatch();
+            waitForDrain();
+            keyChanged = true;
+        }
+    }
+
+    if (current->size + packet.size() > current->data.size()) {
+        pushBatch();
+    }
+
+    uint8_t* dst = current->data.data() + current->size;
+    memcpy(dst, packet.data(), packet.size());
+    size_t offset = current->size;
+    current->size += packet.size();
+
+    if (!scrambledPacket) {
+        return;
+    }
+    if (deferred) {
+        // Left scrambled behind the packets already left to the demux stage.
+        deferDecryption = true;
+        return;
+    }
+
+    // Decrypt the copy in the batch in place.
+    scrambled.mmtp.setWritablePayload({ dst + scrambled.payloadOffset, scrambled.mmtp.payload.size() });
+
+    if (keyChanged) {
+        // Decryption runs ahead of the demux stage, so the packet cannot be
+        // held back here; wait for the key instead.
+        auto keyType = scrambled.mmtp.extensionHeaderScrambling->encryptionFlag;
+        MmtTlv::CasHandler* casHandler = demuxer.getCasHandler();
+        bool decrypted = casHandler && casHandler->waitForKey(keyType, casHandler->getEcmSequence(), kKeyTimeout) &&
+            casHandler->decrypt(scrambled.mmtp);
+
+        if (decrypted) {
+            // The following packets of this key type go with their batch.
+            lastKeyType = keyType;
+            dst[scrambled.flagOffset] &= ~0b00011000;
+        }
+        else {
+            // No key yet, e.g. before the first ECM. The demux stage holds the
+            // packet until the key arrives, as in the serial path.
+            deferDecryption = true;
+        }
+    }
+    else {
+        // The key for this key type is known, decrypt with the rest of the batch.
+        pendingPackets.push_back({ std::move(scrambled.mmtp), offset + scrambled.flagOffset });
+    }
+}
+
+void PipelinedDemuxer::pushBatch() {
+    if (current->size == 0) {
+        return;
+    }
+
+    decryptPending();
+    filledQueue.push(current);
+    ++pushedCount;
+    current = freeQueue.pop();
+
+    if (deferDecryption) {
+        // Decrypt here again once the demux stage has caught up with the
+        // packets left to it. The next scrambled packet looks up its key.
+        waitForDrain();
+        if (!demuxer.hasHeldPackets()) {
+            deferDecryption = false;
+            lastKeyType = MmtTlv::EncryptionFlag::UNSCRAMBLED;
+        }
+    }
+}
+
+void PipelinedDemuxer::decryptPending() {
+    if (pendingPackets.empty()) {
+        return;
+    }
+
+    pendingMmtps.clear();
+    for (auto& pending : pendingPackets) {
+        pendingMmtps.push_back(&pending.mmtp);
+    }
+
+    MmtTlv::CasHandler* casHandler = demuxer.getCasHandler();
+    if (casHandler && casHandler->decrypt(pendingMmtps, decryptionPool)) {
+        uint8_t* data = current->data.data();
+        for (const auto& pending : pendingPackets) {
+            data[pending.flagOffset] &= ~0b00011000;
+        }
+    }
+    else {
+        // Left scrambled, the demux stage holds them until the key arrives.
+        deferDecryption = true;
+    }
+
+    pendingPackets.clear();
+}
+
+void PipelinedDemuxer::waitForDrain() {
+    uint64_t processed;
+    while ((processed = processedCount.load(std::memory_order_acquire)) < pushedCount &&
+        !stopRequested.load(std::memory_order_relaxed)) {
+        processedCount.wait(processed, std::memory_order_acquire);
+    }
+}
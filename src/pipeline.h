@@ -0,0 +1,140 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <span>
+#include <thread>
+#include <vector>
+#include "extensionHeaderScrambling.h"
+#include "mmtp.h"
+#include "output.h"
+#include "spscQueue.h"
+
+class IInputSource;
+class ProgressReporter;
+class ThreadPool;
+
+namespace MmtTlv {
+class MmtTlvDemuxer;
+}
+
+// Moves output writes to a separate thread. Filled buffers are handed to the
+// writer through an SPSC queue and come back through a second one, so the
+// remuxer only waits for I/O when every buffer is in flight.
+class PipelinedOutput : public IOutput {
+public:
+    explicit PipelinedOutput(IOutput& output);
+    ~PipelinedOutput();
+
+    PipelinedOutput(const PipelinedOutput&) = delete;
+    PipelinedOutput& operator=(const PipelinedOutput&) = delete;
+
+    void write(const uint8_t* data, size_t size) override;
+    std::span<uint8_t> reserve(size_t size) override;
+    void commit(size_t size) override;
+    // Waits until the writer has written everything, then flushes the wrapped output.
+    void flush() override;
+    bool hasFailed() const override { return output.hasFailed(); }
+
+private:
+    struct Buffer {
+        std::vector<uint8_t> data;
+        size_t size{0};
+    };
+
+    void submit();
+    void writer();
+
+    static constexpr size_t kBufferSize = 1024 * 1024;
+    static constexpr size_t kBufferCount = 8;
+
+    IOutput& output;
+    std::vector<std::unique_ptr<Buffer>> buffers;
+    SpscQueue<Buffer*> filledQueue{kBufferCount};
+    SpscQueue<Buffer*> freeQueue{kBufferCount};
+    Buffer* current{nullptr};
+    uint64_t submittedCount{0};
+    std::atomic<uint64_t> writtenCount{0};
+    std::thread writerThread;
+};
+
+// Runs the demux loop as two stages on separate threads:
+//  - the framing stage reads the input, copies complete TLV packets into
+//    pooled batch buffers and decrypts scrambled MMTP payloads in place,
+//  - the calling thread feeds the batches to the demuxer (MPU/SI processing
+//    and remuxing through the demuxer handler).
+// Batches travel through SPSC queues, so packet order is kept. Combined with
+// PipelinedOutput, input/decryption, demux/remux and output writes each get
+// their own core.
+// Scrambled packets of a batch that share a key are collected and decrypted
+// together before the batch is handed over, spread over the decryption pool
+// if one is given. Packets whose key is not there yet are left to the demux
+// stage, which holds them until it arrives like the serial path.
+class PipelinedDemuxer {
+public:
+    PipelinedDemuxer(MmtTlv::MmtTlvDemuxer& demuxer, IInputSource& input, ProgressReporter& progressReporter,
+        ThreadPool* decryptionPool = nullptr);
+    ~PipelinedDemuxer();
+
+    PipelinedDemuxer(const PipelinedDemuxer&) = delete;
+    PipelinedDemuxer& operator=(const PipelinedDemuxer&) = delete;
+
+    // Called on the framing stage with the number of input bytes consumed so far.
+    void setPositionCallback(std::function<void(uint64_t)> callback);
+
+    // Demuxes the whole input and returns the number of input bytes consumed.
+    uint64_t run();
+
+private:
+    struct Batch {
+        std::vector<uint8_t> data;
+        size_t size{0};
+    };
+
+    // A scrambled packet in the current batch waiting for batch decryption.
+    // Its payload points into the batch and is decrypted there.
+    struct PendingPacket {
+        MmtTlv::Mmtp mmtp;
+        // Offset from the start of the current batch.
+        size_t flagOffset{0};
+    };
+
+    void framer();
+    void addPacket(std::span<const uint8_t> packet);
+    void pushBatch();
+    void decryptPending();
+    void waitForDrain();
+
+    static constexpr size_t kBatchSize = 1024 * 1024;
+    static constexpr size_t kBatchCount = 8;
+
+    MmtTlv::MmtTlvDemuxer& demuxer;
+    IInputSource& input;
+    ProgressReporter& progressReporter;
+    ThreadPool* decryptionPool;
+    std::function<void(uint64_t)> positionCallback;
+    std::vector<std::unique_ptr<Batch>> batches;
+    SpscQueue<Batch*> filledQueue{kBatchCount + 1};
+    SpscQueue<Batch*> freeQueue{kBatchCount};
+    std::thread framerThread;
+    std::exception_ptr framerError;
+
+    // Framing stage state
+    Batch* current{nullptr};
+    uint64_t pushedCount{0};
+    uint64_t inputBytes{0};
+    MmtTlv::EncryptionFlag lastKeyType{MmtTlv::EncryptionFlag::UNSCRAMBLED};
+    // Set once a scrambled packet has been left to the demux stage. The
+    // following ones are left to it as well, so that it keeps them in order,
+    // until it has caught up and holds no packets anymore.
+    bool deferDecryption{false};
+    std::vector<PendingPacket> pendingPackets;
+    std::vector<MmtTlv::Mmtp*> pendingMmtps;
+
+    // Number of batches the demux stage has finished with.
+    std::atomic<uint64_t> processedCount{0};
+    // Set when the demux stage has failed, the framing stage stops at the next chunk.
+    std::atomic<bool> stopRequested{false};
+};
@@ -176,8 +176,34 @@ void RemuxerHandler::onPacketDrop(uint16_t packetId, const MmtTlv::MmtStream* mm
     }
 }
 
+void RemuxerHandler::setOutput(IOutput* output) {
+    callbackOutput.reset();
+    this->output = output;
+}
+
 void RemuxerHandler::setOutputCallback(OutputCallback cb) {
-    outputCallback = std::move(cb);
+    callbackOutput = std::make_unique<CallbackOutput>(std::move(cb));
+    output = callbackOutput.get();
+}
+
+ts::TSPacket& RemuxerHandler::reservePacket() {
+    static_assert(sizeof(ts::TSPacket) == kTsPacketSize);
+    if (!output) {
+        return scratchPacket;
+    }
+    return *reinterpret_cast<ts::TSPacket*>(output->reserve(kTsPacketSize).data());
+}
+
+void RemuxerHandler::commitPacket() {
+    if (output) {
+        output->commit(kTsPacketSize);
+    }
+}
+
+void RemuxerHandler::writePackets(const ts::TSPacketVector& packets) {
+    if (output && !packets.empty()) {
+        output->write(packets[0].b, packets.size() * kTsPacketSize);
+    }
 }
 
 void RemuxerHandler::writeStream(const MmtTlv::MmtStream& mmtStream, const MmtTlv::MfuData& mfuData, const std::vector<uint8_t>& streamData) {
@@ -225,9 +251,7 @@ void RemuxerHandler::writeStream(const MmtTlv::MmtStream& mmtStream, const MmtTl
 
     pendingData.insert(pendingData.end(), streamData.begin(), streamData.end());
 
-    // Process pending data using the offset
-    while (offset < pendingData.size()) {
-        ts::TSPacket packet;
+    auto initPacket = [&](ts::TSPacket& packet) {
         packet.init(pid, cc & 0xF, 0);
 
         if (packetIndex == 0) {
@@ -236,14 +260,26 @@ void RemuxerHandler::writeStream(const MmtTlv::MmtStream& mmtStream, const MmtTl
                 packet.setRandomAccessIndicator(true);
             }
         }
+    };
 
-        const size_t payloadSize = static_cast<size_t>(188 - packet.getHeaderSize());
+    // Process pending data using the offset
+    while (offset < pendingData.size()) {
         const size_t remainingDataSize = pendingData.size() - offset;
 
-        if (!mfuData.isLastFragment && payloadSize > remainingDataSize) {
-            break;
+        // A packet that would not be filled waits for more data. Decide that on
+        // the scratch packet, a packet reserved in the output must be committed.
+        if (!mfuData.isLastFragment && remainingDataSize < kTsPacketSize) {
+            initPacket(scratchPacket);
+            if (static_cast<size_t>(188 - scratchPacket.getHeaderSize()) > remainingDataSize) {
+                break;
+            }
         }
 
+        ts::TSPacket& packet = reservePacket();
+        initPacket(packet);
+
+        const size_t payloadSize = static_cast<size_t>(188 - packet.getHeaderSize());
+
         ++cc;
 
         const size_t chunkSize = std::min(payloadSize, remainingDataSize);
@@ -256,9 +292,7 @@ void RemuxerHandler::writeStream(const MmtTlv::MmtStream& mmtStream, const MmtTl
 
         offset += chunkSize;
 
-        if (outputCallback) {
-            outputCallback(packet.b, packet.getHeaderSize() + packet.getPayloadSize());
-        }
+        commitPacket();
         packetIndex++;
     }
 
@@ -304,7 +338,7 @@ void RemuxerHandler::writeSubtitle(const MmtTlv::MmtStream& mmtStream, const B24
     size_t payloadLength = pesOutput.size();
     int i = 0;
     while (payloadLength > 0) {
-        ts::TSPacket packet;
+        ts::TSPacket& packet = reservePacket();
         packet.init(pid, cc & 0xF, 0);
         ++cc;
 
@@ -319,9 +353,7 @@ void RemuxerHandler::writeSubtitle(const MmtTlv::MmtStream& mmtStream, const B24
         std::ranges::copy(source_view, dest_view.begin());
         payloadLength -= chunkSize;
 
-        if (outputCallback) {
-            outputCallback(packet.b, packet.getHeaderSize() + packet.getPayloadSize());
-        }
+        commitPacket();
         ++i;
     }
 }
@@ -395,7 +427,7 @@ void RemuxerHandler::writeCaptionManagementData(uint64_t pts) {
         size_t payloadLength = pesOutput.size();
         int i = 0;
         while (payloadLength > 0) {
-            ts::TSPacket packet;
+            ts::TSPacket& packet = reservePacket();
             packet.init(pid, cc & 0xF, 0);
             ++cc;
 
@@ -410,9 +442,7 @@ void RemuxerHandler::writeCaptionManagementData(uint64_t pts) {
             std::ranges::copy(source_view, dest_view.begin());
             payloadLength -= chunkSize;
 
-            if (outputCallback) {
-                outputCallback(packet.b, packet.getHeaderSize() + packet.getPayloadSize());
-            }
+            commitPacket();
             ++i;
         }
     }
@@ -534,11 +564,8 @@ void RemuxerHandler::onMhBit(const MmtTlv::MhBit& mhBit) {
         for (auto& packet : packets) {
             packet.setCC(cc & 0xF);
             cc++;
-
-            if (outputCallback) {
-                outputCallback(packet.b, packet.getHeaderSize() + packet.getPayloadSize());
-            }
         }
+        writePackets(packets);
     }
 }
 
@@ -691,11 +718,8 @@ void RemuxerHandler::onMhEit(const MmtTlv::MhEit& mhEit) {
         for (auto& packet : packets) {
             packet.setCC(cc & 0xF);
             cc++;
-
-            if (outputCallback) {
-                outputCallback(packet.b, packet.getHeaderSize() + packet.getPayloadSize());
-            }
         }
+        writePackets(packets);
     }
 }
 
@@ -755,11 +779,8 @@ void RemuxerHandler::onMhSdtActual(const MmtTlv::MhSdt& mhSdt) {
         for (auto& packet : packets) {
             packet.setCC(cc & 0xF);
             cc++;
-
-            if (outputCallback) {
-                outputCallback(packet.b, packet.getHeaderSize() + packet.getPayloadSize());
-            }
         }
+        writePackets(packets);
     }
 }
 
@@ -803,11 +824,8 @@ void RemuxerHandler::onPlt(const MmtTlv::Plt& plt) {
         for (auto& packet : packets) {
             packet.setCC(cc & 0xF);
             cc++;
-
-            if (outputCallback) {
-                outputCallback(packet.b, packet.getHeaderSize() + packet.getPayloadSize());
-            }
         }
+        writePackets(packets);
     }
 }
 
@@ -934,11 +952,8 @@ void RemuxerHandler::onMpt(const MmtTlv::Mpt& mpt) {
         for (auto& packet : packets) {
             packet.setCC(cc & 0xF);
             cc++;
-
-            if (outputCallback) {
-                outputCallback(packet.b, packet.getHeaderSize() + packet.getPayloadSize());
-            }
         }
+        writePackets(packets);
     }
 }
 
@@ -964,11 +979,8 @@ void RemuxerHandler::onMhTot(const MmtTlv::MhTot& mhTot) {
         for (auto& packet : packets) {
             packet.setCC(cc & 0xF);
             cc++;
-
-            if (outputCallback) {
-                outputCallback(packet.b, packet.getHeaderSize() + packet.getPayloadSize());
-            }
         }
+        writePackets(packets);
     }
 }
 
@@ -997,11 +1009,8 @@ void RemuxerHandler::onMhCdt(const MmtTlv::MhCdt& mhCdt) {
         for (auto& packet : packets) {
             packet.setCC(cc & 0xF);
             cc++;
-
-            if (outputCallback) {
-                outputCallback(packet.b, packet.getHeaderSize() + packet.getPayloadSize());
-            }
         }
+        writePackets(packets);
     }
 }
 
@@ -1058,25 +1067,20 @@ void RemuxerHandler::onNit(const MmtTlv::Nit& nit) {
         for (auto& packet : packets) {
             packet.setCC(cc & 0xF);
             cc++;
-
-            if (outputCallback) {
-                outputCallback(packet.b, packet.getHeaderSize() + packet.getPayloadSize());
-            }
         }
+        writePackets(packets);
     }
 }
 
 void RemuxerHandler::onNtp(const MmtTlv::NTPv4& ntp) {
     auto& cc = mapCC[PCR_PID];
-    ts::TSPacket packet;
+    ts::TSPacket& packet = reservePacket();
     packet.init(PCR_PID, cc & 0xF, 0);
     cc++;
 
     // Add 0.1 seconds to resolve the playback issue in VLC
     packet.setPCR(ntp.transmit_timestamp.toPcrValue() + 2700000, true);
-    if (outputCallback) {
-        outputCallback(packet.b, packet.getHeaderSize() + packet.getPayloadSize());
-    }
+    commitPacket();
 
     lastPcr = ntp.transmit_timestamp.toPcrValue();
 
@@ -2,9 +2,11 @@
 #include "demuxerHandler.h"
 #include "b24SubtitleConvertor.h"
 #include "damt.h"
+#include "output.h"
 #include <tsduck.h>
 #include <unordered_map>
 #include <functional>
+#include <memory>
 
 namespace StreamType {
 
@@ -73,7 +75,11 @@ public:
 	void onPacketDrop(uint16_t packetId, const MmtTlv::MmtStream* mmtStream) override;
 
 public:
-	using OutputCallback = std::function<void(const uint8_t*, size_t)>;
+	// TS packets are built directly in the output's buffer.
+	void setOutput(IOutput* output);
+
+	// Delivers the stream one TS packet per call, for callers without an IOutput.
+	using OutputCallback = CallbackOutput::Callback;
 	void setOutputCallback(OutputCallback cb);
 	void clear();
 
@@ -81,8 +87,13 @@ private:
 	void writeStream(const MmtTlv::MmtStream& mmtStream, const MmtTlv::MfuData& mfuData, const std::vector<uint8_t>& data);
 	void writeSubtitle(const MmtTlv::MmtStream& mmtStream, const B24SubtitleOutput& subtitle);
 	void writeCaptionManagementData(uint64_t pts);
+	ts::TSPacket& reservePacket();
+	void commitPacket();
+	void writePackets(const ts::TSPacketVector& packets);
 	MmtTlv::MmtTlvDemuxer& demuxer;
-	OutputCallback outputCallback;
+	IOutput* output{nullptr};
+	std::unique_ptr<CallbackOutput> callbackOutput;
+	ts::TSPacket scratchPacket;
 	std::unordered_map<uint16_t, uint16_t> mapService2Pid;
 	std::unordered_map<uint16_t, uint8_t> mapCC;
 	std::unordered_map<uint16_t, std::vector<uint8_t>> mapPesPendingData;
@@ -94,4 +105,4 @@ private:
 	inline static const std::vector<uint8_t> ccis = { 0x43, 0x43, 0x49, 0x53, 0x01, 0x3F, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, };
 	ts::DuckContext duck;
 
-};
\ No newline at end of file
+};
\ No newline at end of file
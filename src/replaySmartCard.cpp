@@ -0,0 +1,386 @@
+#include "replaySmartCard.h"
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <thread>
+#include "acasCard.h"
+
+namespace {
+
+constexpr char kMagic[8] = { 'D', 'T', '4', 'K', 'A', 'P', 'D', 'U' };
+constexpr uint32_t kVersion = 1;
+constexpr size_t kHeaderSize = 16;
+// Session, transmit result, command length and response length.
+constexpr size_t kRecordHeaderSize = 12;
+
+constexpr uint8_t kInsA0 = 0xA0;
+constexpr uint8_t kInsEcm = 0x34;
+// Not sent to cards: marks the records of resolveEcm() calls.
+constexpr uint8_t kInsResolvedEcm = 0x00;
+
+// Offsets in the A0 command data and response data, see AcasCard::getA0AuthKcl.
+constexpr size_t kA0InitOffset = 8;
+constexpr size_t kA0ResponseOffset = 0x06;
+constexpr size_t kA0HashOffset = 0x0e;
+// Offsets in the ECM and the ECM response data, see AcasCard::ecm.
+constexpr size_t kEcmInitOffset = 0x04;
+constexpr size_t kEcmInitSize = 0x17;
+constexpr size_t kEcmKeyOffset = 0x06;
+
+void putLe16(std::vector<uint8_t>& output, uint16_t value) {
+    output.push_back(static_cast<uint8_t>(value));
+    output.push_back(static_cast<uint8_t>(value >> 8));
+}
+
+void putLe32(std::vector<uint8_t>& output, uint32_t value) {
+    putLe16(output, static_cast<uint16_t>(value));
+    putLe16(output, static_cast<uint16_t>(value >> 16));
+}
+
+uint32_t getLe32(const uint8_t* data) {
+    return data[0] | (data[1] << 8) | (data[2] << 16) | (static_cast<uint32_t>(data[3]) << 24);
+}
+
+uint16_t getLe16(const uint8_t* data) {
+    return static_cast<uint16_t>(data[0] | (data[1] << 8));
+}
+
+// Data of a case 3 or case 4 short command.
+std::optional<std::vector<uint8_t>> getCommandData(const std::vector<uint8_t>& command) {
+    if (command.size() < 5 || command.size() < 5 + static_cast<size_t>(command[4])) {
+        return std::nullopt;
+    }
+    return std::vector<uint8_t>(command.begin() + 5, command.begin() + 5 + command[4]);
+}
+
+sha256_t getKcl(const uint8_t* a0init, const uint8_t* a0response) {
+    std::vector<uint8_t> plainKcl(std::begin(AcasCard::masterKey), std::end(AcasCard::masterKey));
+    plainKcl.insert(plainKcl.end(), a0init, a0init + 8);
+    plainKcl.insert(plainKcl.end(), a0response, a0response + 8);
+    return SHA256::hash(plainKcl);
+}
+
+// XORs the key material of an ECM response with the mask of the given session key.
+void applyEcmMask(const sha256_t& kcl, const std::vector<uint8_t>& ecm, std::vector<uint8_t>& data) {
+    std::vector<uint8_t> plainData(kcl.begin(), kcl.end());
+    plainData.insert(plainData.end(), ecm.begin() + kEcmInitOffset, ecm.begin() + kEcmInitOffset + kEcmInitSize);
+    sha256_t mask = SHA256::hash(plainData);
+    for (size_t i = 0; i < mask.size(); ++i) {
+        data[kEcmKeyOffset + i] ^= mask[i];
+    }
+}
+
+bool hasEcmKey(const std::vector<uint8_t>& ecm, const std::vector<uint8_t>& data) {
+    return ecm.size() >= kEcmInitOffset + kEcmInitSize && data.size() >= kEcmKeyOffset + sizeof(sha256_t);
+}
+
+}
+
+CaptureSmartCard::CaptureSmartCard(std::unique_ptr<ISmartCard> smartCard, const std::string& path)
+    : smartCard(std::move(smartCard)), session(std::random_device{}()) {
+    // Create the file with its header unless it exists already.
+    if (std::FILE* created = std::fopen(path.c_str(), "wbx")) {
+        uint8_t header[kHeaderSize] = {};
+        memcpy(header, kMagic, sizeof(kMagic));
+        memcpy(header + 8, &kVersion, 4);
+        bool written = std::fwrite(header, 1, sizeof(header), created) == sizeof(header);
+        std::fclose(created);
+        if (!written) {
+            throw std::runtime_error("Failed to write the smart card capture: " + path);
+        }
+    }
+
+    file = std::fopen(path.c_str(), "ab");
+    if (!file) {
+        throw std::runtime_error("Failed to open the smart card capture: " + path);
+    }
+    // Every record goes out in a single write.
+    std::setvbuf(file, nullptr, _IONBF, 0);
+}
+
+CaptureSmartCard::~CaptureSmartCard() {
+    if (file) {
+        std::fclose(file);
+    }
+}
+
+bool CaptureSmartCard::init() {
+    return smartCard->init();
+}
+
+void CaptureSmartCard::connect() {
+    smartCard->connect();
+}
+
+void CaptureSmartCard::disconnect() {
+    smartCard->disconnect();
+}
+
+bool CaptureSmartCard::isConnected() const {
+    return smartCard->isConnected();
+}
+
+bool CaptureSmartCard::isInited() const {
+    return smartCard->isInited();
+}
+
+std::vector<std::string> CaptureSmartCard::getReaders() const {
+    return smartCard->getReaders();
+}
+
+uint32_t CaptureSmartCard::transmit(const std::vector<uint8_t>& message, ApduResponse& response) {
+    uint32_t result = smartCard->transmit(message, response);
+    writeRecord(result, message, response);
+    return result;
+}
+
+uint32_t CaptureSmartCard::resolveEcm(const std::vector<uint8_t>& ecm, ApduResponse& response) {
+    uint32_t result = smartCard->resolveEcm(ecm, response);
+    if (result != SCARD_E_UNSUPPORTED_FEATURE) {
+        writeRecord(result, ApduCommand(0x90, kInsResolvedEcm, 0x00, 0x01).case4short(ecm, 0x00), response);
+    }
+    return result;
+}
+
+uint32_t CaptureSmartCard::prepareResolveEcm() {
+    return smartCard->prepareResolveEcm();
+}
+
+void CaptureSmartCard::writeRecord(uint32_t result, const std::vector<uint8_t>& command, const ApduResponse& response) {
+    std::vector<uint8_t> responseBytes;
+    if (result == SCARD_S_SUCCESS) {
+        responseBytes = response.getData();
+        responseBytes.push_back(response.getSw1());
+        responseBytes.push_back(response.getSw2());
+    }
+
+    std::vector<uint8_t> record;
+    record.reserve(kRecordHeaderSize + command.size() + responseBytes.size());
+    putLe32(record, session);
+    putLe32(record, result);
+    putLe16(record, static_cast<uint16_t>(command.size()));
+    putLe16(record, static_cast<uint16_t>(responseBytes.size()));
+    record.insert(record.end(), command.begin(), command.end());
+    record.insert(record.end(), responseBytes.begin(), responseBytes.end());
+    if (file && std::fwrite(record.data(), 1, record.size(), file) != record.size()) {
+        std::cerr << "Unable to write to the smart card capture" << std::endl;
+        std::fclose(file);
+        file = nullptr;
+    }
+}
+
+void CaptureSmartCard::setSmartCardReaderName(const std::string& name) {
+    smartCard->setSmartCardReaderName(name);
+}
+
+std::string CaptureSmartCard::getSmartCardReaderName() const {
+    return smartCard->getSmartCardReaderName();
+}
+
+bool CaptureSmartCard::isExclusive() const {
+    return smartCard->isExclusive();
+}
+
+void CaptureSmartCard::beginTransaction() {
+    transaction = smartCard->scopedTransaction();
+}
+
+void CaptureSmartCard::endTransaction() {
+    transaction.reset();
+}
+
+ReplaySmartCard::ReplaySmartCard(const std::string& path, std::chrono::microseconds latency)
+    : latency(latency) {
+    load(path);
+}
+
+void ReplaySmartCard::load(const std::string& path) {
+    std::ifstream fs(path, std::ios::binary);
+    if (!fs) {
+        throw std::runtime_error("Failed to open the smart card capture: " + path);
+    }
+    std::vector<uint8_t> buffer((std::istreambuf_iterator<char>(fs)), std::istreambuf_iterator<char>());
+
+    if (buffer.size() < kHeaderSize || memcmp(buffer.data(), kMagic, sizeof(kMagic)) != 0 ||
+        getLe32(buffer.data() + 8) != kVersion) {
+        throw std::runtime_error("Not a smart card capture: " + path);
+    }
+
+    // Session key of every capture session, taken from its last A0 exchange.
+    std::map<uint32_t, sha256_t> sessionKcls;
+
+    size_t pos = kHeaderSize;
+    while (buffer.size() - pos >= kRecordHeaderSize) {
+        const uint8_t* header = buffer.data() + pos;
+        uint32_t session = getLe32(header);
+        uint32_t result = getLe32(header + 4);
+        size_t commandLength = getLe16(header + 8);
+        size_t responseLength = getLe16(header + 10);
+        if (buffer.size() - pos - kRecordHeaderSize < commandLength + responseLength) {
+            // Cut short by a crash while capturing.
+            break;
+        }
+
+        auto commandBegin = buffer.begin() + pos + kRecordHeaderSize;
+        std::vector<uint8_t> command(commandBegin, commandBegin + commandLength);
+        std::vector<uint8_t> data(commandBegin + commandLength, commandBegin + commandLength + responseLength);
+        pos += kRecordHeaderSize + commandLength + responseLength;
+
+        if (result != SCARD_S_SUCCESS || command.size() < 5 || data.size() < 2) {
+            continue;
+        }
+        uint8_t sw1 = data[data.size() - 2];
+        uint8_t sw2 = data[data.size() - 1];
+        data.resize(data.size() - 2);
+        bool success = sw1 == 0x90 && sw2 == 0x00;
+
+        auto commandData = getCommandData(command);
+        if (command[1] == kInsA0) {
+            if (success && commandData && commandData->size() >= kA0InitOffset + 8 && data.size() >= kA0HashOffset) {
+                sessionKcls[session] = getKcl(commandData->data() + kA0InitOffset, data.data() + kA0ResponseOffset);
+            }
+        }
+        else if (command[1] == kInsEcm && commandData) {
+            EcmResponse ecmResponse{ sw1, sw2, data };
+            if (success && hasEcmKey(*commandData, data)) {
+                auto kcl = sessionKcls.find(session);
+                if (kcl == sessionKcls.end()) {
+                    // The key material cannot be recovered without the A0 exchange.
+                    continue;
+                }
+                applyEcmMask(kcl->second, *commandData, ecmResponse.data);
+                ecmResponse.hasKey = true;
+            }
+
+            auto it = ecmResponses.find(*commandData);
+            if (it == ecmResponses.end() || (!it->second.hasKey && ecmResponse.hasKey)) {
+                ecmResponses[*commandData] = std::move(ecmResponse);
+            }
+        }
+        else if (command[1] == kInsResolvedEcm && commandData) {
+            // Laid out like the response to the ECM command, with the keys in the clear.
+            std::vector<uint8_t> ecmData(kEcmKeyOffset, 0);
+            ecmData.insert(ecmData.end(), data.begin(), data.end());
+            EcmResponse ecmResponse{ sw1, sw2, std::move(ecmData) };
+            ecmResponse.hasKey = success && hasEcmKey(*commandData, ecmResponse.data);
+
+            auto it = ecmResponses.find(*commandData);
+            if (it == ecmResponses.end() || (!it->second.hasKey && ecmResponse.hasKey)) {
+                ecmResponses[*commandData] = std::move(ecmResponse);
+            }
+        }
+        else {
+            otherResponses.emplace(command, ApduResponse(sw1, sw2, data));
+        }
+    }
+}
+
+bool ReplaySmartCard::init() {
+    inited = true;
+    return true;
+}
+
+void ReplaySmartCard::connect() {
+    // A new session starts unauthenticated, like after a card reset.
+    kcl.reset();
+    connected = true;
+}
+
+void ReplaySmartCard::disconnect() {
+    connected = false;
+}
+
+bool ReplaySmartCard::isConnected() const {
+    return connected;
+}
+
+bool ReplaySmartCard::isInited() const {
+    return inited;
+}
+
+std::vector<std::string> ReplaySmartCard::getReaders() const {
+    return { "Replay" };
+}
+
+uint32_t ReplaySmartCard::transmit(const std::vector<uint8_t>& message, ApduResponse& response) {
+    if (latency.count() > 0) {
+        std::this_thread::sleep_for(latency);
+    }
+    if (!connected) {
+        return SCARD_E_INVALID_HANDLE;
+    }
+    if (message.size() < 5) {
+        // Wrong length
+        response = ApduResponse(0x67, 0x00);
+        return SCARD_S_SUCCESS;
+    }
+
+    switch (message[1]) {
+    case kInsA0:
+        response = authenticate(message);
+        break;
+    case kInsEcm:
+        response = answerEcm(message);
+        break;
+    default:
+    {
+        auto it = otherResponses.find(message);
+        // Instruction not supported
+        response = it != otherResponses.end() ? it->second : ApduResponse(0x6D, 0x00);
+        break;
+    }
+    }
+    return SCARD_S_SUCCESS;
+}
+
+ApduResponse ReplaySmartCard::authenticate(const std::vector<uint8_t>& message) {
+    auto commandData = getCommandData(message);
+    if (!commandData || commandData->size() < kA0InitOffset + 8) {
+        return ApduResponse(0x67, 0x00);
+    }
+
+    const uint8_t* a0init = commandData->data() + kA0InitOffset;
+    // The card's half of the challenge, derived from the host's so that replays are repeatable.
+    sha256_t a0response = SHA256::hash(std::vector<uint8_t>(a0init, a0init + 8));
+    kcl = getKcl(a0init, a0response.data());
+
+    std::vector<uint8_t> plainData(kcl->begin(), kcl->end());
+    plainData.insert(plainData.end(), a0init, a0init + 8);
+    sha256_t hash = SHA256::hash(plainData);
+
+    std::vector<uint8_t> data(kA0ResponseOffset, 0);
+    data.insert(data.end(), a0response.begin(), a0response.begin() + 8);
+    data.insert(data.end(), hash.begin(), hash.end());
+    return ApduResponse(0x90, 0x00, data);
+}
+
+ApduResponse ReplaySmartCard::answerEcm(const std::vector<uint8_t>& message) const {
+    auto commandData = getCommandData(message);
+    auto it = commandData ? ecmResponses.find(*commandData) : ecmResponses.end();
+    if (it == ecmResponses.end() || (it->second.hasKey && !kcl)) {
+        // Not in the capture, or no A0 authentication in this session.
+        return ApduResponse(0x6A, 0x00);
+    }
+
+    const EcmResponse& ecmResponse = it->second;
+    std::vector<uint8_t> data = ecmResponse.data;
+    if (ecmResponse.hasKey) {
+        applyEcmMask(*kcl, *commandData, data);
+    }
+    return ApduResponse(ecmResponse.sw1, ecmResponse.sw2, data);
+}
+
+void ReplaySmartCard::setSmartCardReaderName(const std::string& name) {
+    smartCardReaderName = name;
+}
+
+std::string ReplaySmartCard::getSmartCardReaderName() const {
+    return smartCardReaderName;
+}
+
+void ReplaySmartCard::beginTransaction() {
+}
+
+void ReplaySmartCard::endTransaction() {
+}
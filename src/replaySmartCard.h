@@ -0,0 +1,106 @@
+#pragma once
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <map>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+#include "sha256.h"
+#include "smartCard.h"
+
+// Smart card traffic captures, for running the whole decryption path on
+// machines without a card reader.
+//
+// A capture file is a header followed by one record per transmitted APDU:
+// the capture session, the transmit result, the command and the response
+// including its status word. Records are appended with a single write each,
+// so several cards can share a file; the session tells them apart. ECMs that
+// the card resolved itself, see ISmartCard::resolveEcm(), are recorded like
+// an ECM command with a separate instruction and the keys in the clear.
+
+// Wraps a smart card and appends every APDU it transmits to a capture file.
+class CaptureSmartCard : public ISmartCard {
+public:
+    // Throws std::runtime_error if the capture file cannot be opened.
+    CaptureSmartCard(std::unique_ptr<ISmartCard> smartCard, const std::string& path);
+    ~CaptureSmartCard();
+    bool init() override;
+    void connect() override;
+    void disconnect() override;
+    bool isConnected() const override;
+    bool isInited() const override;
+    std::vector<std::string> getReaders() const override;
+    uint32_t transmit(const std::vector<uint8_t>& message, ApduResponse& response) override;
+    void setSmartCardReaderName(const std::string& name) override;
+    std::string getSmartCardReaderName() const override;
+    bool isExclusive() const override;
+    uint32_t resolveEcm(const std::vector<uint8_t>& ecm, ApduResponse& response) override;
+    uint32_t prepareResolveEcm() override;
+
+protected:
+    void beginTransaction() override;
+    void endTransaction() override;
+
+private:
+    void writeRecord(uint32_t result, const std::vector<uint8_t>& command, const ApduResponse& response);
+
+    std::unique_ptr<ISmartCard> smartCard;
+    std::unique_ptr<Transaction> transaction;
+    std::FILE* file{nullptr};
+    uint32_t session;
+
+};
+
+// Answers APDUs from a capture file instead of a smart card.
+// A0 authentication uses a fresh challenge every time, so its responses are
+// computed like the card does rather than replayed. The key material of every
+// captured ECM response is recovered with the session key of its capture
+// session and encrypted again with the current one. Other commands are
+// answered with the captured response of the same command. ECMs that are not
+// in the capture are rejected.
+class ReplaySmartCard : public ISmartCard {
+public:
+    // Throws std::runtime_error if the capture file cannot be read.
+    // Every transmit takes at least latency, to stand in for a real card.
+    ReplaySmartCard(const std::string& path, std::chrono::microseconds latency = {});
+    bool init() override;
+    void connect() override;
+    void disconnect() override;
+    bool isConnected() const override;
+    bool isInited() const override;
+    std::vector<std::string> getReaders() const override;
+    uint32_t transmit(const std::vector<uint8_t>& message, ApduResponse& response) override;
+    void setSmartCardReaderName(const std::string& name) override;
+    std::string getSmartCardReaderName() const override;
+    // Only this process sends APDUs to the capture.
+    bool isExclusive() const override { return true; }
+
+protected:
+    void beginTransaction() override;
+    void endTransaction() override;
+
+private:
+    // A captured ECM response with its key material in the clear.
+    struct EcmResponse {
+        uint8_t sw1;
+        uint8_t sw2;
+        std::vector<uint8_t> data;
+        bool hasKey{false};
+    };
+
+    void load(const std::string& path);
+    ApduResponse authenticate(const std::vector<uint8_t>& message);
+    ApduResponse answerEcm(const std::vector<uint8_t>& message) const;
+
+    std::chrono::microseconds latency;
+    bool inited{false};
+    bool connected{false};
+    std::string smartCardReaderName;
+
+    std::map<std::vector<uint8_t>, EcmResponse> ecmResponses;
+    std::map<std::vector<uint8_t>, ApduResponse> otherResponses;
+    std::optional<sha256_t> kcl;
+
+};
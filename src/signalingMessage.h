@@ -1,5 +1,5 @@
 #pragma once
-#include <vector>
+#include <span>
 #include "stream.h"
 #include "mmtFragment.h"
 
@@ -15,7 +15,8 @@ public:
 	bool aggregationFlag;
 	uint8_t fragmentCounter;
 
-	std::vector<uint8_t> payload;
+	// A view into the buffer the message was unpacked from.
+	std::span<const uint8_t> payload;
 };
 
 }
\ No newline at end of file
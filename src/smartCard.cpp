@@ -172,9 +172,9 @@ void LocalSmartCard::connect() {
     }
 
 #ifdef WIN32
-    result = pSCardConnect(hContext, readerName.c_str(), SCARD_SHARE_SHARED, SCARD_PROTOCOL_T1, &hCard, &dwActiveProtocol);
+    result = pSCardConnect(hContext, readerName.c_str(), exclusive ? SCARD_SHARE_EXCLUSIVE : SCARD_SHARE_SHARED, SCARD_PROTOCOL_T1, &hCard, &dwActiveProtocol);
 #else
-    result = SCardConnect(hContext, readerName.c_str(), SCARD_SHARE_SHARED, SCARD_PROTOCOL_T1, &hCard, &dwActiveProtocol);
+    result = SCardConnect(hContext, readerName.c_str(), exclusive ? SCARD_SHARE_EXCLUSIVE : SCARD_SHARE_SHARED, SCARD_PROTOCOL_T1, &hCard, &dwActiveProtocol);
 #endif
     if (result != SCARD_S_SUCCESS) {
         std::this_thread::sleep_for(std::chrono::seconds(1));
@@ -235,6 +235,14 @@ std::string LocalSmartCard::getSmartCardReaderName() const {
     return smartCardReaderName;
 }
 
+bool LocalSmartCard::isExclusive() const {
+    return exclusive;
+}
+
+void LocalSmartCard::setExclusive(bool enabled) {
+    exclusive = enabled;
+}
+
 void LocalSmartCard::disconnect() {
     if (hCard != 0) {
 #ifdef WIN32
@@ -271,17 +279,21 @@ void LocalSmartCard::endTransaction() {
 }
 
 RemoteSmartCard::RemoteSmartCard(std::string casProxyHost, uint16_t port) {
-    client = std::make_unique<CasProxyClient>(casProxyHost, port);
+    client = std::make_shared<CasProxyClient>(casProxyHost, port);
     client->connect();
 }
 
+RemoteSmartCard::RemoteSmartCard(std::shared_ptr<CasProxyClient> client)
+    : client(std::move(client)) {
+}
+
 bool RemoteSmartCard::init() {
     LONG result = client->scardEstablishContext(SCARD_SCOPE_USER, nullptr, nullptr, &hContext);
     return result == SCARD_S_SUCCESS;
 }
 
 RemoteSmartCard::~RemoteSmartCard() {
-    client->close();
+    // The client closes with its last card.
 }
 
 bool RemoteSmartCard::isConnected() const {
@@ -378,7 +390,7 @@ void RemoteSmartCard::connect() {
         readerName = smartCardReaderName;
     }
 
-    result = client->scardConnect(hContext, readerName.c_str(), SCARD_SHARE_SHARED, SCARD_PROTOCOL_T1, &hCard, &dwActiveProtocol);
+    result = client->scardConnect(hContext, readerName.c_str(), exclusive ? SCARD_SHARE_EXCLUSIVE : SCARD_SHARE_SHARED, SCARD_PROTOCOL_T1, &hCard, &dwActiveProtocol);
     if (result != SCARD_S_SUCCESS) {
         std::this_thread::sleep_for(std::chrono::seconds(1));
 
@@ -439,6 +451,42 @@ std::string RemoteSmartCard::getSmartCardReaderName() const {
     return smartCardReaderName;
 }
 
+uint32_t RemoteSmartCard::resolveEcm(const std::vector<uint8_t>& ecm, ApduResponse& response) {
+    if (!proxyEcm) {
+        return SCARD_E_UNSUPPORTED_FEATURE;
+    }
+
+    uint16_t sw = 0;
+    std::vector<uint8_t> key;
+    LONG result = client->acasEcm(smartCardReaderName, ecm, sw, key);
+    if (result != SCARD_S_SUCCESS) {
+        return result;
+    }
+
+    response = ApduResponse(static_cast<uint8_t>(sw >> 8), static_cast<uint8_t>(sw), key);
+    return result;
+}
+
+uint32_t RemoteSmartCard::prepareResolveEcm() {
+    if (!proxyEcm) {
+        return SCARD_E_UNSUPPORTED_FEATURE;
+    }
+
+    return client->waitConnected() ? SCARD_S_SUCCESS : SCARD_E_NO_SERVICE;
+}
+
+void RemoteSmartCard::setProxyEcm(bool enabled) {
+    proxyEcm = enabled;
+}
+
+bool RemoteSmartCard::isExclusive() const {
+    return exclusive;
+}
+
+void RemoteSmartCard::setExclusive(bool enabled) {
+    exclusive = enabled;
+}
+
 void RemoteSmartCard::disconnect() {
     if (hCard != 0) {
         client->scardDisconnect(hCard, SCARD_LEAVE_CARD);
@@ -79,6 +79,18 @@ public:
     virtual uint32_t transmit(const std::vector<uint8_t>& message, ApduResponse& response) = 0;
     virtual void setSmartCardReaderName(const std::string& name) = 0;
     virtual std::string getSmartCardReaderName() const = 0;
+    // Cards that run the whole ACAS exchange themselves, e.g. a CAS proxy next
+    // to the card, resolve an ECM in one call. The response data is the odd
+    // key followed by the even key. Returns SCARD_E_UNSUPPORTED_FEATURE for
+    // cards that only transmit APDUs.
+    virtual uint32_t resolveEcm(const std::vector<uint8_t>& ecm, ApduResponse& response) { return SCARD_E_UNSUPPORTED_FEATURE; }
+    // Gets ready for resolveEcm() ahead of the first ECM, e.g. connects to the
+    // proxy. Returns SCARD_E_UNSUPPORTED_FEATURE like resolveEcm().
+    virtual uint32_t prepareResolveEcm() { return SCARD_E_UNSUPPORTED_FEATURE; }
+    // Whether nobody else can send APDUs to the card while it is connected.
+    // A shared card may be authenticated by another client between two
+    // transactions, which replaces the session key of the card.
+    virtual bool isExclusive() const { return false; }
 
 public:
     class Transaction {
@@ -109,6 +121,9 @@ public:
     uint32_t transmit(const std::vector<uint8_t>& message, ApduResponse& response) override;
     virtual void setSmartCardReaderName(const std::string& name);
     virtual std::string getSmartCardReaderName() const;
+    bool isExclusive() const override;
+    // Connects with SCARD_SHARE_EXCLUSIVE instead of SCARD_SHARE_SHARED.
+    void setExclusive(bool enabled);
 
 protected:
     void beginTransaction() override;
@@ -143,12 +158,15 @@ private:
     SCARDHANDLE hCard = 0;
     DWORD dwActiveProtocol = 0;
     std::string smartCardReaderName;
+    bool exclusive{false};
 
 };
 
 class RemoteSmartCard : public ISmartCard {
 public:
     RemoteSmartCard(std::string casProxyHost, uint16_t casProxyPort);
+    // Shares the connection of client with other cards, e.g. a card pool.
+    explicit RemoteSmartCard(std::shared_ptr<CasProxyClient> client);
     ~RemoteSmartCard();
     bool init() override;
     void connect() override;
@@ -159,6 +177,14 @@ public:
     uint32_t transmit(const std::vector<uint8_t>& message, ApduResponse& response) override;
     virtual void setSmartCardReaderName(const std::string& name);
     virtual std::string getSmartCardReaderName() const;
+    uint32_t resolveEcm(const std::vector<uint8_t>& ecm, ApduResponse& response) override;
+    uint32_t prepareResolveEcm() override;
+    // Sends whole ECMs to the proxy instead of the APDUs of the exchange.
+    // The proxy must support the ACAS requests.
+    void setProxyEcm(bool enabled);
+    bool isExclusive() const override;
+    // Connects with SCARD_SHARE_EXCLUSIVE instead of SCARD_SHARE_SHARED.
+    void setExclusive(bool enabled);
 
 protected:
     void beginTransaction() override;
@@ -169,7 +195,9 @@ private:
     SCARDHANDLE hCard = 0;
     DWORD dwActiveProtocol = 0;
     std::string smartCardReaderName;
-    std::unique_ptr<CasProxyClient> client;
+    std::shared_ptr<CasProxyClient> client;
+    bool proxyEcm{false};
+    bool exclusive{false};
 
 
 };
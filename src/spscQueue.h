@@ -0,0 +1,87 @@
+#pragma once
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <vector>
+
+// Bounded lock-free queue for exactly one producer thread and one consumer
+// thread. push() and pop() block with std::atomic::wait when the queue is
+// full or empty.
+template <typename T>
+class SpscQueue {
+public:
+    // capacity is rounded up to a power of two.
+    explicit SpscQueue(size_t capacity)
+        : slots(std::bit_ceil(capacity)), mask(slots.size() - 1) {
+    }
+
+    SpscQueue(const SpscQueue&) = delete;
+    SpscQueue& operator=(const SpscQueue&) = delete;
+
+    bool tryPush(T value) {
+        size_t t = tail.load(std::memory_order_relaxed);
+        if (t - head.load(std::memory_order_acquire) == slots.size()) {
+            return false;
+        }
+
+        slots[t & mask] = std::move(value);
+        tail.store(t + 1, std::memory_order_release);
+        tail.notify_one();
+        return true;
+    }
+
+    bool tryPop(T& value) {
+        size_t h = head.load(std::memory_order_relaxed);
+        if (h == tail.load(std::memory_order_acquire)) {
+            return false;
+        }
+
+        value = std::move(slots[h & mask]);
+        head.store(h + 1, std::memory_order_release);
+        head.notify_one();
+        return true;
+    }
+
+    void push(T value) {
+        size_t t = tail.load(std::memory_order_relaxed);
+        while (true) {
+            size_t h = head.load(std::memory_order_acquire);
+            if (t - h < slots.size()) {
+                break;
+            }
+            head.wait(h, std::memory_order_acquire);
+        }
+
+        slots[t & mask] = std::move(value);
+        tail.store(t + 1, std::memory_order_release);
+        tail.notify_one();
+    }
+
+    T pop() {
+        size_t h = head.load(std::memory_order_relaxed);
+        while (true) {
+            size_t t = tail.load(std::memory_order_acquire);
+            if (h != t) {
+                break;
+            }
+            tail.wait(t, std::memory_order_acquire);
+        }
+
+        T value = std::move(slots[h & mask]);
+        head.store(h + 1, std::memory_order_release);
+        head.notify_one();
+        return value;
+    }
+
+    bool empty() const {
+        return head.load(std::memory_order_acquire) == tail.load(std::memory_order_acquire);
+    }
+
+private:
+    std::vector<T> slots;
+    size_t mask;
+    // Next slot to pop, written by the consumer only.
+    alignas(64) std::atomic<size_t> head{0};
+    // Next slot to push, written by the producer only.
+    alignas(64) std::atomic<size_t> tail{0};
+};
@@ -4,6 +4,13 @@ namespace MmtTlv {
     
 namespace Common {
 
+ReadStream::ReadStream(std::span<const uint8_t> buffer)
+    : buffer(buffer)
+{
+    this->hasSize = true;
+    this->size = buffer.size();
+}
+
 ReadStream::ReadStream(const std::vector<uint8_t>& buffer)
     : buffer(buffer)
 {
@@ -1,6 +1,7 @@
 #pragma once
 #include <stdexcept>
 #include <vector>
+#include <optional>
 #include <span>
 #include <cstring>
 #include "swap.h"
@@ -9,8 +10,55 @@ namespace MmtTlv {
 
 namespace Common {
 
+// Decodes the fields of a header without bounds checks. Parsers check once
+// that the whole header is there and get a reader for it from
+// ReadStream::getHeader(), so malformed input costs a comparison rather than
+// an exception.
+class HeaderReader final {
+public:
+    explicit HeaderReader(const uint8_t* data)
+        : data(data) {}
+
+    void skip(size_t size) {
+        data += size;
+    }
+
+    uint8_t get8U() {
+        return *data++;
+    }
+
+    uint16_t getBe16U() {
+        return swapEndian16(getObject<uint16_t>());
+    }
+
+    uint32_t getBe32U() {
+        return swapEndian32(getObject<uint32_t>());
+    }
+
+    uint64_t getBe64U() {
+        return swapEndian64(getObject<uint64_t>());
+    }
+
+    void read(void* dst, size_t size) {
+        memcpy(dst, data, size);
+        data += size;
+    }
+
+private:
+    template<typename T>
+    T getObject() {
+        T value;
+        memcpy(&value, data, sizeof(T));
+        data += sizeof(T);
+        return value;
+    }
+
+    const uint8_t* data;
+};
+
 class ReadStream final {
 public:
+    explicit ReadStream(std::span<const uint8_t> data);
     explicit ReadStream(const std::vector<uint8_t>& data);
     explicit ReadStream(const std::vector<uint8_t>& data, size_t size);
     explicit ReadStream(ReadStream& stream, size_t size);
@@ -52,6 +100,30 @@ public:
         return readBytes;
     }
 
+    // Skips a header of size bytes and returns a reader for its fields, or
+    // std::nullopt if fewer bytes are left. Never throws.
+    std::optional<HeaderReader> getHeader(size_t size) {
+        if (this->size - pos < size) {
+            return std::nullopt;
+        }
+
+        HeaderReader header(buffer.data() + pos);
+        pos += size;
+        return header;
+    }
+
+    // Returns a view of the next size bytes without copying them. The view
+    // points into the buffer the stream reads from.
+    std::span<const uint8_t> getSpan(size_t size) {
+        if (this->size < pos + size) {
+            throw std::out_of_range("Access out of bounds");
+        }
+
+        auto data = buffer.subspan(pos, size);
+        pos += size;
+        return data;
+    }
+
     size_t peek(void* dst, size_t size) {
         if (this->size < pos + size) {
             throw std::out_of_range("Access out of bounds");
@@ -119,7 +191,7 @@ private:
         return *reinterpret_cast<const T*>(buffer.data() + pos);
     }
 
-    const std::vector<uint8_t>& buffer;
+    std::span<const uint8_t> buffer;
     bool hasSize = false;
     mutable size_t size = 0;
     mutable size_t pos = 0;
@@ -0,0 +1,111 @@
+#include "threadPool.h"
+#include <algorithm>
+
+namespace {
+
+// Pool and deque index of the current thread, if it is a pool thread.
+thread_local const ThreadPool* currentPool = nullptr;
+thread_local size_t currentIndex = 0;
+
+}
+
+ThreadPool::ThreadPool(size_t threadCount) {
+    if (threadCount == 0) {
+        threadCount = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    for (size_t i = 0; i < threadCount; ++i) {
+        queues.push_back(std::make_unique<WorkQueue>());
+    }
+    for (size_t i = 0; i < threadCount; ++i) {
+        threads.emplace_back(&ThreadPool::run, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    wait();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        running = false;
+    }
+
+    workCv.notify_all();
+    for (auto& thread : threads) {
+        thread.join();
+    }
+}
+
+void ThreadPool::submit(Task task) {
+    size_t index = currentPool == this ? currentIndex : nextQueue.fetch_add(1, std::memory_order_relaxed) % queues.size();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        ++unfinishedTasks;
+        queuedTasks.fetch_add(1, std::memory_order_relaxed);
+    }
+    {
+        std::lock_guard<std::mutex> lock(queues[index]->mutex);
+        queues[index]->tasks.push_back(std::move(task));
+    }
+    workCv.notify_one();
+}
+
+void ThreadPool::wait() {
+    std::unique_lock<std::mutex> lock(mutex);
+    idleCv.wait(lock, [&]() {
+        return unfinishedTasks == 0;
+    });
+}
+
+void ThreadPool::run(size_t index) {
+    currentPool = this;
+    currentIndex = index;
+
+    while (true) {
+        Task task;
+        if (pop(index, task) || steal(index, task)) {
+            queuedTasks.fetch_sub(1, std::memory_order_relaxed);
+            task();
+
+            std::lock_guard<std::mutex> lock(mutex);
+            if (--unfinishedTasks == 0) {
+                idleCv.notify_all();
+            }
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(mutex);
+        workCv.wait(lock, [&]() {
+            return queuedTasks.load(std::memory_order_relaxed) > 0 || !running;
+        });
+        if (!running) {
+            break;
+        }
+    }
+}
+
+bool ThreadPool::pop(size_t index, Task& task) {
+    WorkQueue& queue = *queues[index];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (queue.tasks.empty()) {
+        return false;
+    }
+
+    task = std::move(queue.tasks.back());
+    queue.tasks.pop_back();
+    return true;
+}
+
+bool ThreadPool::steal(size_t index, Task& task) {
+    for (size_t i = 1; i < queues.size(); ++i) {
+        WorkQueue& queue = *queues[(index + i) % queues.size()];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (queue.tasks.empty()) {
+            continue;
+        }
+
+        task = std::move(queue.tasks.front());
+        queue.tasks.pop_front();
+        return true;
+    }
+    return false;
+}
@@ -0,0 +1,49 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed-size thread pool with one task deque per thread. A thread runs its
+// own tasks newest first and steals the oldest task of another thread when
+// it runs dry. Tasks submitted from a pool thread go to that thread's deque.
+class ThreadPool {
+public:
+    using Task = std::function<void()>;
+
+    // threadCount 0 uses one thread per hardware thread.
+    explicit ThreadPool(size_t threadCount = 0);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    void submit(Task task);
+    // Blocks until every submitted task has finished.
+    void wait();
+    size_t size() const { return threads.size(); }
+
+private:
+    struct WorkQueue {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    void run(size_t index);
+    bool pop(size_t index, Task& task);
+    bool steal(size_t index, Task& task);
+
+    std::vector<std::unique_ptr<WorkQueue>> queues;
+    std::vector<std::thread> threads;
+    std::mutex mutex;
+    std::condition_variable workCv;
+    std::condition_variable idleCv;
+    std::atomic<size_t> queuedTasks{0};
+    size_t unfinishedTasks{0};
+    std::atomic<size_t> nextQueue{0};
+    bool running{true};
+};
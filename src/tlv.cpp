@@ -5,24 +5,24 @@ namespace MmtTlv {
 	
 bool Tlv::unpack(Common::ReadStream& stream)
 {
-	if (stream.leftBytes() < 4) {
+	auto header = stream.getHeader(4);
+	if (!header) {
 		return false;
 	}
 
-	uint8_t syncByte = stream.get8U();
+	uint8_t syncByte = header->get8U();
 	if (syncByte != 0x7F) {
 		throw std::runtime_error("Not valid tlv packet.");
 	}
 
-	packetType = stream.get8U();
-	dataLength = stream.getBe16U();
+	packetType = header->get8U();
+	dataLength = header->getBe16U();
 
 	if (stream.leftBytes() < dataLength) {
 		return false;
 	}
 
-	data.resize(dataLength);
-	stream.read(data.data(), dataLength);
+	data = stream.getSpan(dataLength);
 	return true;
 }
 
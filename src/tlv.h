@@ -1,5 +1,5 @@
 #pragma once
-#include <vector>
+#include <span>
 #include "ip.h"
 #include "stream.h"
 #include "compressedIPPacket.h"
@@ -22,13 +22,14 @@ public:
 	TlvPacketType getPacketType() const { return static_cast<TlvPacketType>(packetType); }
 	uint16_t getDataLength() const { return dataLength; }
 	const CompressedIPPacket& getCompressedIPPacket() const { return compressedIPPacket; }
-	const std::vector<uint8_t>& getData() const { return data; }
+	std::span<const uint8_t> getData() const { return data; }
 
 private:
 	uint8_t packetType;
 	uint16_t dataLength;
 	CompressedIPPacket compressedIPPacket;
-	std::vector<uint8_t> data;
+	// A view into the buffer the packet was unpacked from.
+	std::span<const uint8_t> data;
 };
 
 }
\ No newline at end of file
@@ -0,0 +1,525 @@
+#include "uringIo.h"
+
+#ifdef USE_IO_URING
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <iomanip>
+#include <new>
+#include <stdexcept>
+#include <vector>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <liburing.h>
+
+namespace {
+
+constexpr size_t kAlignment = 4096;
+
+struct AlignedDelete {
+    void operator()(uint8_t* p) const {
+        ::operator delete[](p, std::align_val_t(kAlignment));
+    }
+};
+
+using AlignedBuffer = std::unique_ptr<uint8_t, AlignedDelete>;
+
+AlignedBuffer allocateAligned(size_t size) {
+    return AlignedBuffer(static_cast<uint8_t*>(::operator new[](size, std::align_val_t(kAlignment))));
+}
+
+// Reads consecutive chunks of a regular file with positional reads, keeping
+// one read per buffer in flight. Like ReadAheadInputSource, the unconsumed tail
+// of a chunk is copied into the headroom in front of the next one.
+class UringInputSource : public IInputSource {
+public:
+    UringInputSource(size_t chunkSize, size_t queueDepth)
+        : chunkSize(chunkSize), buffers(queueDepth) {
+    }
+
+    ~UringInputSource() {
+        close();
+    }
+
+    UringInputSource(const UringInputSource&) = delete;
+    UringInputSource& operator=(const UringInputSource&) = delete;
+
+    bool open(const std::string& path) {
+        fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            return false;
+        }
+
+        struct stat st;
+        if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+            close();
+            return false;
+        }
+
+        if (io_uring_queue_init(static_cast<unsigned>(buffers.size()), &ring, 0) < 0) {
+            close();
+            return false;
+        }
+        ringReady = true;
+
+        size = static_cast<uint64_t>(st.st_size);
+        posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+        for (size_t i = 0; i < buffers.size(); ++i) {
+            buffers[i].memory = allocateAligned(kCarrySize + chunkSize);
+            queueRead(i);
+        }
+        submit();
+        return true;
+    }
+
+    void close() {
+        if (ringReady) {
+            // Outstanding reads still target our buffers.
+            while (!inFlight.empty()) {
+                size_t index = inFlight.front();
+                inFlight.pop_front();
+                waitFor(index);
+            }
+            io_uring_queue_exit(&ring);
+            ringReady = false;
+        }
+        if (fd >= 0) {
+            ::close(fd);
+            fd = -1;
+        }
+    }
+
+    std::span<const uint8_t> next() override {
+        if (isEof()) {
+            return { viewBegin, viewSize };
+        }
+
+        size_t index = inFlight.front();
+        inFlight.pop_front();
+
+        auto start = std::chrono::steady_clock::now();
+        waitFor(index);
+        demuxerWaitTime += std::chrono::steady_clock::now() - start;
+
+        if (viewSize > kCarrySize) {
+            throw std::runtime_error("Unconsumed input exceeds the io_uring carry size");
+        }
+
+        // Move the unconsumed tail in front of the new chunk.
+        uint8_t* chunk = buffers[index].memory.get() + kCarrySize;
+        if (viewSize > 0) {
+            memcpy(chunk - viewSize, viewBegin, viewSize);
+        }
+        viewBegin = chunk - viewSize;
+        viewSize += buffers[index].filled;
+
+        // The previous buffer is no longer referenced, reuse it for the next chunk.
+        if (current) {
+            queueRead(*current);
+            submit();
+        }
+        current = index;
+
+        return { viewBegin, viewSize };
+    }
+
+    void consume(size_t size) override {
+        viewBegin += size;
+        viewSize -= size;
+    }
+
+    bool isEof() const override {
+        // After a failed read the chunks behind it are not handed out.
+        return inFlight.empty() || failed;
+    }
+
+    uint64_t getSize() const override {
+        return size;
+    }
+
+    void printStatistics() const override {
+        std::cerr << "Input:" << std::endl;
+        std::cerr << " - Demuxer waited on I/O: " << std::fixed << std::setprecision(3) << std::chrono::duration<double>(demuxerWaitTime).count() << "s" << std::endl;
+        std::cerr << " - io_uring reads: " << readCount << " in " << submitCount << " submissions" << std::endl;
+    }
+
+private:
+    struct Buffer {
+        AlignedBuffer memory;
+        uint64_t offset{0};
+        size_t length{0};
+        size_t filled{0};
+        bool done{false};
+    };
+
+    void queueRead(size_t index) {
+        if (failed || nextOffset >= size) {
+            return;
+        }
+
+        Buffer& buffer = buffers[index];
+        buffer.offset = nextOffset;
+        buffer.length = static_cast<size_t>(std::min<uint64_t>(chunkSize, size - nextOffset));
+        buffer.filled = 0;
+        buffer.done = false;
+        nextOffset += buffer.length;
+
+        inFlight.push_back(index);
+        prepareRead(buffer);
+    }
+
+    void prepareRead(Buffer& buffer) {
+        // The ring has one entry per buffer, so there is always a free SQE.
+        io_uring_sqe* sqe = io_uring_get_sqe(&ring);
+        io_uring_prep_read(sqe, fd, buffer.memory.get() + kCarrySize + buffer.filled,
+            static_cast<unsigned>(buffer.length - buffer.filled), buffer.offset + buffer.filled);
+        io_uring_sqe_set_data(sqe, &buffer);
+        ++pendingCount;
+        ++readCount;
+    }
+
+    void submit() {
+        if (pendingCount == 0) {
+            return;
+        }
+
+        int ret = io_uring_submit(&ring);
+        if (ret < 0) {
+            throw std::runtime_error(std::string("io_uring_submit failed: ") + strerror(-ret));
+        }
+        pendingCount = 0;
+        ++submitCount;
+    }
+
+    void waitFor(size_t index) {
+        while (!buffers[index].done) {
+            io_uring_cqe* cqe = nullptr;
+            int ret = io_uring_wait_cqe(&ring, &cqe);
+            if (ret == -EINTR) {
+                continue;
+            }
+            if (ret < 0) {
+                throw std::runtime_error(std::string("io_uring_wait_cqe failed: ") + strerror(-ret));
+            }
+
+            Buffer* buffer = static_cast<Buffer*>(io_uring_cqe_get_data(cqe));
+            int res = cqe->res;
+            io_uring_cqe_seen(&ring, cqe);
+
+            if (res == -EINTR || res == -EAGAIN) {
+                prepareRead(*buffer);
+                submit();
+                continue;
+            }
+
+            if (res < 0) {
+                // Stop reading ahead, the data read so far is still handed out.
+                if (!failed) {
+                    std::cerr << "Input read failed: " << strerror(-res) << std::endl;
+                }
+                failed = true;
+                buffer->done = true;
+                continue;
+            }
+
+            buffer->filled += static_cast<size_t>(res);
+            if (res == 0 || buffer->filled == buffer->length) {
+                // A zero-length read means the file was truncated while reading.
+                buffer->done = true;
+            }
+            else {
+                prepareRead(*buffer);
+                submit();
+            }
+        }
+    }
+
+    // Room in front of every chunk for the unconsumed tail of the previous one.
+    // A TLV packet is at most 65539 bytes long.
+    static constexpr size_t kCarrySize = 256 * 1024;
+
+    size_t chunkSize;
+    std::vector<Buffer> buffers;
+    io_uring ring{};
+    bool ringReady{false};
+    int fd{-1};
+    uint64_t size{0};
+    uint64_t nextOffset{0};
+    bool failed{false};
+
+    // Buffers with a queued or completed read, in file order.
+    std::deque<size_t> inFlight;
+    size_t pendingCount{0};
+
+    std::optional<size_t> current;
+    const uint8_t* viewBegin{nullptr};
+    size_t viewSize{0};
+
+    std::chrono::steady_clock::duration demuxerWaitTime{};
+    uint64_t readCount{0};
+    uint64_t submitCount{0};
+};
+
+// Collects the output into a set of buffers and writes full buffers with
+// positional writes. Submissions are batched so that a single io_uring_submit
+// call hands several buffers to the kernel while the others are being filled.
+class UringOutput : public IOutput {
+public:
+    UringOutput(size_t bufferSize, size_t bufferCount)
+        : bufferSize(bufferSize), buffers(bufferCount) {
+        for (auto& buffer : buffers) {
+            buffer.memory = allocateAligned(bufferSize);
+        }
+    }
+
+    ~UringOutput() {
+        close();
+    }
+
+    UringOutput(const UringOutput&) = delete;
+    UringOutput& operator=(const UringOutput&) = delete;
+
+    bool open(const std::string& path) {
+        fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd < 0) {
+            return false;
+        }
+
+        if (io_uring_queue_init(static_cast<unsigned>(buffers.size()), &ring, 0) < 0) {
+            close();
+            return false;
+        }
+        ringReady = true;
+        return true;
+    }
+
+    void close() {
+        if (ringReady) {
+            flush();
+            io_uring_queue_exit(&ring);
+            ringReady = false;
+        }
+        if (fd >= 0) {
+            ::close(fd);
+            fd = -1;
+        }
+    }
+
+    void write(const uint8_t* data, size_t size) override {
+        while (size > 0) {
+            Buffer& buffer = buffers[current];
+            size_t length = std::min(size, bufferSize - buffer.length);
+            memcpy(buffer.memory.get() + buffer.length, data, length);
+            buffer.length += length;
+            data += length;
+            size -= length;
+
+            if (buffer.length == bufferSize) {
+                queueWrite(buffer);
+                acquireNext();
+            }
+        }
+    }
+
+    std::span<uint8_t> reserve(size_t size) override {
+        Buffer& buffer = buffers[current];
+        if (buffer.length + size > bufferSize) {
+            queueWrite(buffer);
+            acquireNext();
+        }
+        return { buffers[current].memory.get() + buffers[current].length, size };
+    }
+
+    void commit(size_t size) override {
+        Buffer& buffer = buffers[current];
+        buffer.length += size;
+        if (buffer.length == bufferSize) {
+            queueWrite(buffer);
+            acquireNext();
+        }
+    }
+
+    void flush() override {
+        Buffer& buffer = buffers[current];
+        if (buffer.length > 0) {
+            queueWrite(buffer);
+            acquireNext();
+        }
+
+        submit();
+        while (inFlightCount > 0) {
+            reap();
+        }
+    }
+
+    bool hasFailed() const override {
+        return failed;
+    }
+
+private:
+    struct Buffer {
+        AlignedBuffer memory;
+        uint64_t offset{0};
+        size_t length{0};
+        size_t written{0};
+        bool busy{false};
+    };
+
+    void queueWrite(Buffer& buffer) {
+        if (failed) {
+            buffer.length = 0;
+            return;
+        }
+
+        buffer.offset = fileOffset;
+        buffer.written = 0;
+        buffer.busy = true;
+        fileOffset += buffer.length;
+        ++inFlightCount;
+        prepareWrite(buffer);
+
+        if (pendingCount >= buffers.size() / 2) {
+            submit();
+        }
+    }
+
+    void prepareWrite(Buffer& buffer) {
+        // The ring has one entry per buffer, so there is always a free SQE.
+        io_uring_sqe* sqe = io_uring_get_sqe(&ring);
+        io_uring_prep_write(sqe, fd, buffer.memory.get() + buffer.written,
+            static_cast<unsigned>(buffer.length - buffer.written), buffer.offset + buffer.written);
+        io_uring_sqe_set_data(sqe, &buffer);
+        ++pendingCount;
+    }
+
+    void acquireNext() {
+        current = (current + 1) % buffers.size();
+        while (buffers[current].busy) {
+            submit();
+            reap();
+        }
+    }
+
+    void submit() {
+        if (pendingCount == 0) {
+            return;
+        }
+
+        int ret = io_uring_submit(&ring);
+        if (ret < 0) {
+            throw std::runtime_error(std::string("io_uring_submit failed: ") + strerror(-ret));
+        }
+        pendingCount = 0;
+    }
+
+    // Waits for at least one completion and handles every completion available.
+    void reap() {
+        io_uring_cqe* cqe = nullptr;
+        int ret = io_uring_wait_cqe(&ring, &cqe);
+        if (ret == -EINTR) {
+            return;
+        }
+        if (ret < 0) {
+            throw std::runtime_error(std::string("io_uring_wait_cqe failed: ") + strerror(-ret));
+        }
+
+        do {
+            Buffer* buffer = static_cast<Buffer*>(io_uring_cqe_get_data(cqe));
+            int res = cqe->res;
+            io_uring_cqe_seen(&ring, cqe);
+            complete(*buffer, res);
+        } while (io_uring_peek_cqe(&ring, &cqe) == 0);
+    }
+
+    void complete(Buffer& buffer, int res) {
+        if (res == -EINTR || res == -EAGAIN) {
+            prepareWrite(buffer);
+            submit();
+            return;
+        }
+
+        if (res < 0 && !failed) {
+            std::cerr << "Output write failed: " << strerror(-res) << std::endl;
+            failed = true;
+        }
+
+        if (res > 0) {
+            buffer.written += static_cast<size_t>(res);
+            if (buffer.written < buffer.length && !failed) {
+                prepareWrite(buffer);
+                submit();
+                return;
+            }
+        }
+
+        buffer.length = 0;
+        buffer.busy = false;
+        --inFlightCount;
+    }
+
+    size_t bufferSize;
+    std::vector<Buffer> buffers;
+    size_t current{0};
+    io_uring ring{};
+    bool ringReady{false};
+    int fd{-1};
+    uint64_t fileOffset{0};
+    size_t inFlightCount{0};
+    size_t pendingCount{0};
+    bool failed{false};
+};
+
+}
+
+bool isUringAvailable() {
+    static bool available = []() {
+        io_uring ring;
+        if (io_uring_queue_init(2, &ring, 0) < 0) {
+            return false;
+        }
+        io_uring_queue_exit(&ring);
+        return true;
+    }();
+    return available;
+}
+
+std::unique_ptr<IInputSource> openUringInputSource(const std::string& path, size_t chunkSize) {
+    constexpr size_t queueDepth = 4;
+
+    auto source = std::make_unique<UringInputSource>(chunkSize, queueDepth);
+    if (!source->open(path)) {
+        return nullptr;
+    }
+    return source;
+}
+
+std::unique_ptr<IOutput> openUringOutput(const std::string& path) {
+    constexpr size_t bufferSize = 1024 * 1024;
+    constexpr size_t bufferCount = 8;
+
+    auto output = std::make_unique<UringOutput>(bufferSize, bufferCount);
+    if (!output->open(path)) {
+        return nullptr;
+    }
+    return output;
+}
+
+#else
+
+bool isUringAvailable() {
+    return false;
+}
+
+std::unique_ptr<IInputSource> openUringInputSource(const std::string&, size_t) {
+    return nullptr;
+}
+
+std::unique_ptr<IOutput> openUringOutput(const std::string&) {
+    return nullptr;
+}
+
+#endif
@@ -0,0 +1,19 @@
+#pragma once
+#include <memory>
+#include <string>
+#include "inputSource.h"
+#include "output.h"
+
+// io_uring based file I/O for Linux. Only built in when liburing is found at
+// build time (USE_IO_URING); otherwise every function reports it unavailable.
+
+// Returns true if io_uring is compiled in and the kernel allows creating a ring.
+bool isUringAvailable();
+
+// Keeps several chunk reads of a regular file in flight at once.
+// Returns nullptr if the path is not a regular file or the ring cannot be set up.
+std::unique_ptr<IInputSource> openUringInputSource(const std::string& path, size_t chunkSize);
+
+// Batches output buffers into asynchronous positional writes.
+// Returns nullptr if the file cannot be created or the ring cannot be set up.
+std::unique_ptr<IOutput> openUringOutput(const std::string& path);